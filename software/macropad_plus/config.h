@@ -16,6 +16,36 @@
 #define PIN_ENC_SW          PC3       // connected to rotary encoder switch
 #define PIN_NEO             PC6       // connected to NeoPixels (do not change!)
 
+// Key list: X(key number, pin, NeoPixel index), key n is bit n-1 of the key state.
+// All keys must be on the same GPIO port, which is read at once on every scan.
+// Colors and actions of the keys are defined in KEY_actions[] in macros.h.
+#define KEY_PINS(X)         X(1, PIN_KEY1, 0) X(2, PIN_KEY2, 1) X(3, PIN_KEY3, 2) \
+                            X(4, PIN_KEY4, 3) X(5, PIN_KEY5, 4) X(6, PIN_KEY6, 5)
+
+// Key matrix for larger boards (KEY_MATRIX = 1, replaces KEY_PINS): rows X(row, pin)
+// are pulled low one after another (open-drain), columns X(column, pin) are read
+// with pullups from one GPIO port. Key n sits in row (n-1)/columns and column
+// (n-1)%columns, NeoPixel n-1 belongs to key n. Columns wake up the MCU via EXTI,
+// so they must not use line 2 (USB D-).
+#define KEY_MATRIX          0         // 0: one pin per key, 1: key matrix
+#define KEY_ROWS(X)         X(1, PC0) X(2, PC1) X(3, PC2)
+#define KEY_COLS(X)         X(1, PD0) X(2, PD4) X(3, PD5) X(4, PD6)
+#define KEY_DIODES          1         // 1: diode per key, 0: suppress ghost keys
+#define KEY_SETTLE_US       2         // column settle time after row select in us
+
+// Debounce per key: X(key number, algorithm, window), one entry per key.
+// DEB_EAGER:     press at once, release after window ms without bounce (low latency)
+// DEB_DEFER:     press and release after window ms without bounce (noisy switches)
+// DEB_INTEGRATE: press/release after window more pressed/released scans
+#define KEY_DEBOUNCE(X)     X(1, DEB_EAGER, 5) X(2, DEB_EAGER, 5) X(3, DEB_EAGER, 5) \
+                            X(4, DEB_EAGER, 5) X(5, DEB_EAGER, 5) X(6, DEB_EAGER, 5)
+
+// Input polling
+#define INPUT_IDLE_TIMEOUT  200       // ms without input until slow polling
+#define INPUT_IDLE_PERIOD   10        // polling period in ms when idle
+#define INPUT_CAPTURE       1         // 1: timestamp key 4/6 edges with timer2 capture
+#define ENC_HOLD_MS         6         // encoder hold and pause in ms (max 1000/2/ENC_HOLD_MS detents/s)
+
 // USB pin definitions
 #define USB_PORT            A         // [A,C,D] GPIO Port to use with D+, D- and DPU
 #define USB_PIN_DP          1         // [0-4] GPIO Number for USB D+ Pin
@@ -24,6 +54,9 @@
 // USB configuration descriptor
 #define USB_MAX_POWER_mA    50        // max power in mA 
 
+// NeoPixel current budget (USB budget minus MCU and board consumption)
+#define NEO_MAX_mA          (USB_MAX_POWER_mA - 15)
+
 // USB device descriptor
 #define USB_VENDOR_ID       0x1209    // VID
 #define USB_PRODUCT_ID      0xc003    // PID
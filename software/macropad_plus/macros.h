@@ -11,91 +11,30 @@
 // +---+---+---+    -----
 */
 
-// Key 1 example -> mouse wheel up (scroll page)
-// ---------------------------------------------
-
-// Define action(s) if key1 was pressed
-static inline void KEY1_PRESSED() {
-                                                      // nothing to do
-}
-
-// Define action(s) if key1 was released
-static inline void KEY1_RELEASED() {
-                                                      // nothing to do
-}
+// Key actions
+// -----------
+// Each key is described by one entry in KEY_actions[] below (key 1 first):
+// - hue:       NeoPixel color while the key is pressed (0..255)
+// - chord:     up to 3 keyboard keys, pressed in this order when the key is pressed
+//              and released in reverse order when the key is released
+// - pressed:   function called when the key is pressed (after the chord)
+// - released:  function called when the key is released (after the chord)
+// - hold:      function called while the key is held, right after the press and
+//              then every 'repeat' milliseconds
+// Unused fields can be omitted. Pin and NeoPixel of each key are set in config.h.
 
-// Define action(s) when key1 is held
-static inline void KEY1_HOLD() {
+// Key 1 example -> mouse wheel up (scroll page)
+static void KEY1_HOLD(void) {
   MOUSE_wheel_up();                                   // turn mouse wheel up
-  DLY_ms(10);                                         // delay
 }
 
 // Key 2 example -> ALT + TAB (switch application)
-// -----------------------------------------------
-
-// Define action(s) if key2 was pressed
-static inline void KEY2_PRESSED() {
-  KBD_press(KBD_KEY_LEFT_ALT);                        // press left ALT key
-}
-
-// Define action(s) if key2 was released
-static inline void KEY2_RELEASED() {
-  KBD_release(KBD_KEY_LEFT_ALT);                      // release left ALT key
-}
-
-// Define action(s) when key2 is held
-static inline void KEY2_HOLD() {
+static void KEY2_HOLD(void) {
   KBD_type(KBD_KEY_TAB);                              // press and release TAB key
-  DLY_ms(500);                                        // delay
-}
-
-// Key 3 example -> WIN + DOWN ARROW (show apps)
-// ---------------------------------------------
-
-// Define action(s) if key3 was pressed
-static inline void KEY3_PRESSED() {
-  KBD_press(KBD_KEY_LEFT_GUI);                        // press left WIN key
-  KBD_press(KBD_KEY_DOWN_ARROW);                      // press DOWN ARROW key
-}
-
-// Define action(s) if key3 was released
-static inline void KEY3_RELEASED() {
-  KBD_release(KBD_KEY_DOWN_ARROW);                    // release DOWN ARROW key
-  KBD_release(KBD_KEY_LEFT_GUI);                      // release left WIN key
-}
-
-// Define action(s) when key3 is held
-static inline void KEY3_HOLD() {
-                                                      // nothing to do
-}
-
-// Key 4 example -> CTRL + ALT + DEL (shutdown)
-// --------------------------------------------
-
-// Define action(s) if key4 was pressed
-static inline void KEY4_PRESSED() {
-  KBD_press(KBD_KEY_LEFT_CTRL);                       // press left CTRL key
-  KBD_press(KBD_KEY_LEFT_ALT);                        // press left ALT key
-  KBD_press(KBD_KEY_DELETE);                          // press DEL key
-}
-
-// Define action(s) if key4 was released
-static inline void KEY4_RELEASED() {
-  KBD_release(KBD_KEY_DELETE);                        // release DEL key
-  KBD_release(KBD_KEY_LEFT_ALT);                      // release left ALT key
-  KBD_release(KBD_KEY_LEFT_CTRL);                     // release left CTRL key
-}
-
-// Define action(s) when key4 is held
-static inline void KEY4_HOLD() {
-                                                      // nothing to do
 }
 
 // Key 5 example -> Linux open terminal and run shutdown command
-// -------------------------------------------------------------
-
-// Define action(s) if key5 was pressed
-static inline void KEY5_PRESSED() {
+static void KEY5_PRESSED(void) {
   KBD_press(KBD_KEY_LEFT_GUI);                        // press left WIN key
   KBD_type('t');                                      // press and release 'T' key
   DLY_ms(500);                                        // wait for terminal to open
@@ -104,35 +43,37 @@ static inline void KEY5_PRESSED() {
   KBD_type(KBD_KEY_RETURN);                           // press and release RETURN key
 }
 
-// Define action(s) if key5 was released
-static inline void KEY5_RELEASED() {
-                                                      // nothing to do
-}
-
-// Define action(s) when key5 is held
-static inline void KEY5_HOLD() {
-                                                      // nothing to do
-}
-
 // Key 6 example -> mouse wheel down (scroll page)
-// -----------------------------------------------
-
-// Define action(s) if key6 was pressed
-static inline void KEY6_PRESSED() {
-                                                      // nothing to do
-}
-
-// Define action(s) if key6 was released
-static inline void KEY6_RELEASED() {
-                                                      // nothing to do
-}
-
-// Define action(s) when key6 is held
-static inline void KEY6_HOLD() {
+static void KEY6_HOLD(void) {
   MOUSE_wheel_down();                                 // turn mouse wheel down
-  DLY_ms(10);                                         // delay
 }
 
+// Key descriptor (one per key in KEY_actions[])
+typedef struct {
+  uint8_t  hue;                                       // NeoPixel hue while pressed
+  uint8_t  chord[3];                                  // keyboard keys held down (0: none)
+  uint16_t repeat;                                    // period of hold action in ms
+  void (*pressed)(void);                              // action on press (NULL: none)
+  void (*released)(void);                             // action on release (NULL: none)
+  void (*hold)(void);                                 // repeated while held (NULL: none)
+} KEY_action_t;
+
+// Key descriptor table
+static const KEY_action_t KEY_actions[] = {
+  // Key 1: red, mouse wheel up while held
+  { .hue =   0, .hold = KEY1_HOLD, .repeat = 10 },
+  // Key 2: yellow, ALT held down, TAB typed every 500ms
+  { .hue =  43, .chord = {KBD_KEY_LEFT_ALT}, .hold = KEY2_HOLD, .repeat = 500 },
+  // Key 3: green, WIN + DOWN ARROW
+  { .hue =  85, .chord = {KBD_KEY_LEFT_GUI, KBD_KEY_DOWN_ARROW} },
+  // Key 4: cyan, CTRL + ALT + DEL
+  { .hue = 128, .chord = {KBD_KEY_LEFT_CTRL, KBD_KEY_LEFT_ALT, KBD_KEY_DELETE} },
+  // Key 5: blue, open terminal and type shutdown command
+  { .hue = 171, .pressed = KEY5_PRESSED },
+  // Key 6: magenta, mouse wheel down while held
+  { .hue = 213, .hold = KEY6_HOLD, .repeat = 10 }
+};
+
 // Rotary encoder example -> volume control knob
 // ---------------------------------------------
 
@@ -170,14 +111,11 @@ static inline void ENC_SW_RELEASED() {
 // NeoPixel Configuration
 // ===================================================================================
 
-// Global NeoPixel brightness
-#define NEO_BRIGHT_KEYS   2         // NeoPixel brightness for keys (0..2)
-#define NEO_BRIGHT_ENC    0         // NeoPixel brightness for encoder ring (0..2)
-
-// Key colors (hue value: 0..191)
-#define NEO_KEY1          0         // red
-#define NEO_KEY2          32        // yellow
-#define NEO_KEY3          64        // green
-#define NEO_KEY4          96        // cyan
-#define NEO_KEY5          128       // blue
-#define NEO_KEY6          160       // magenta
+// Global NeoPixel brightness (gamma corrected)
+#define NEO_BRIGHT_KEYS   255       // NeoPixel brightness for keys (0..255)
+#define NEO_BRIGHT_ENC    140       // NeoPixel brightness for encoder ring (0..255)
+
+// Global NeoPixel color saturation
+#define NEO_SAT_KEYS      255       // NeoPixel saturation for keys (0..255)
+#define NEO_SAT_ENC       255       // NeoPixel saturation for encoder ring (0..255)
+
@@ -5,10 +5,23 @@
 
 #include "encoder_tim.h"
 
+// Input capture channels 1/2 on TI1/TI2 with input filter
+#define ENC_CHCTLR  (TIM_CC1S_0 | TIM_CC2S_0 | (ENC_FILTER << 4) | (ENC_FILTER << 12))
+
+// Get next detent step from count value and last detent position
+static int8_t ENC_step(uint16_t cnt, uint16_t *pos) {
+  int16_t diff = cnt - *pos;
+  if(diff >=  ENC_DETENT) { *pos += ENC_DETENT; return  1; }
+  if(diff <= -ENC_DETENT) { *pos -= ENC_DETENT; return -1; }
+  return 0;
+}
+
 // ===================================================================================
 // Rotary Encoder 1 using Timer1
 // ===================================================================================
 
+uint16_t ENC1_pos;                          // count of last detent
+
 // Init rotary encoder 1 pins and setup timer1 in encoder mode
 void ENC1_init(void) {
   // Setup pins
@@ -42,15 +55,17 @@ void ENC1_init(void) {
   #endif
 
   // Setup timer
+  TIM1->CHCTLR1   = ENC_CHCTLR;             // inputs with filter
   TIM1->SMCFGR    = (uint16_t)0b011;        // set encoder mode 3
-  TIM1->CTLR1     = TIM_CEN;                // enable/start timer2
+  TIM1->CTLR1     = ENC_CKD | TIM_CEN;      // set filter clock, enable/start timer1
 }
 
 // Set rotary encoder 1 current and maximum count value
 void ENC1_set(uint16_t cur, uint16_t max) {
-  TIM1->CNT    = cur;                       // set current count value (timer2 counter)
-  TIM1->ATRLR  = max;                       // set max count value (timer2 auto-reload)
-  TIM1->SWEVGR = TIM_UG;                    // re-initialize timer
+  ENC1_pos     = cur;                       // detent at current count
+  TIM1->ATRLR  = max;                       // set max count value (timer1 auto-reload)
+  TIM1->SWEVGR = TIM_UG;                    // re-initialize timer (clears counter)
+  TIM1->CNT    = cur;                       // set current count value (timer1 counter)
 }
 
 // Read rotary encoder 1 current count value
@@ -58,10 +73,17 @@ uint16_t ENC1_get(void) {
   return TIM1->CNT;                         // read current counter value
 }
 
+// Get next detent step of rotary encoder 1
+int8_t ENC1_step(void) {
+  return ENC_step(TIM1->CNT, &ENC1_pos);
+}
+
 // ===================================================================================
 // Rotary Encoder 2 using Timer2
 // ===================================================================================
 
+uint16_t ENC2_pos;                          // count of last detent
+
 // Init rotary encoder 2 pins and setup timer2 in encoder mode
 void ENC2_init(void) {
   // Setup pins
@@ -99,18 +121,25 @@ void ENC2_init(void) {
 
   // Setup timer
   RCC->APB1PCENR |= RCC_TIM2EN;             // enable timer2 module
+  TIM2->CHCTLR1   = ENC_CHCTLR;             // inputs with filter
   TIM2->SMCFGR    = (uint16_t)0b011;        // set encoder mode 3
-  TIM2->CTLR1     = TIM_CEN;                // enable/start timer2
+  TIM2->CTLR1     = ENC_CKD | TIM_CEN;      // set filter clock, enable/start timer2
 }
 
 // Set rotary encoder 2 current and maximum count value
 void ENC2_set(uint16_t cur, uint16_t max) {
-  TIM2->CNT    = cur;                       // set current count value (timer2 counter)
+  ENC2_pos     = cur;                       // detent at current count
   TIM2->ATRLR  = max;                       // set max count value (timer2 auto-reload)
-  TIM2->SWEVGR = TIM_UG;                    // re-initialize timer
+  TIM2->SWEVGR = TIM_UG;                    // re-initialize timer (clears counter)
+  TIM2->CNT    = cur;                       // set current count value (timer2 counter)
 }
 
 // Read rotary encoder 2 current count value
 uint16_t ENC2_get(void) {
   return TIM2->CNT;                         // read current counter value
 }
+
+// Get next detent step of rotary encoder 2
+int8_t ENC2_step(void) {
+  return ENC_step(TIM2->CNT, &ENC2_pos);
+}
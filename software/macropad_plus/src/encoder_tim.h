@@ -10,10 +10,12 @@
 // ENC1_init()              Init rotary encoder 1 pins and setup timer1 in encoder mode
 // ENC1_set(cur, max)       Set rotary encoder 1 current and maximum count value
 // ENC1_get()               Read rotary encoder 1 current count value
+// ENC1_step()              Get next detent step of encoder 1 (1: up, -1: down, 0: none)
 //
 // ENC2_init()              Init rotary encoder 2 pins and setup timer2 in encoder mode
 // ENC2_set(cur, max)       Set rotary encoder 2 current and maximum count value
 // ENC2_get()               Read rotary encoder 2 current count value
+// ENC2_step()              Get next detent step of encoder 2 (1: up, -1: down, 0: none)
 //
 // ENC pin mapping (set below in encoder parameters):
 // --------------------------------------------------
@@ -31,7 +33,25 @@
 //   rotation of the encoder. Note that depending on the type of encoder, this
 //   value changes by 2 or 4 per detent. The count value wraps around.
 // - The rotary encoder must be connected so that it switches to ground.
-// - For reliable operation, hardware debouncing is recommended.
+// - Both inputs pass the digital input filter of the timer (ENC_FILTER). An edge is
+//   only counted after the input was stable for 8 samples at fDTS / 32, with fDTS
+//   set by ENC_CKD (F_CPU / 4, i.e. samples at F_CPU / 128), which removes short
+//   spikes. Contact bounce on one input makes the count step
+//   back and forth by one and cancels itself in the quadrature decoder, so no
+//   software debouncing is needed.
+// - ENCx_step() turns the count into detent steps: a step is reported when the
+//   count has moved ENC_DETENT counts away from the last detent. A bouncing
+//   contact at a detent toggles the count by one only, so it never causes a
+//   phantom or lost step. Several detents turned between two calls are returned
+//   one per call and are not lost. The encoder must be at a detent when it is set
+//   and the maximum count value must be 0xffff.
+// - Throughput cap (macropad main loop): each detent is sent to the host as a
+//   press, held for ENC_HOLD_MS, and a release, followed by a pause of
+//   ENC_HOLD_MS. So one detent takes 2 * ENC_HOLD_MS, which is 12ms or about
+//   83 detents/s with the default of 6ms. The hold cannot be much shorter: the
+//   device answers the 1ms IN polls round-robin for its three report IDs, so each
+//   report reaches the host only every 3ms. Faster turns are not lost. Timer1
+//   keeps counting and the extra detents are sent late, one after the other.
 //
 // 2024 by Stefan Wagner:   https://github.com/wagiminator
 
@@ -44,17 +64,22 @@ extern "C" {
 #include "system.h"
 
 // Encoder Parameters
-#define ENC1_MAP    1
+#define ENC1_MAP    2
 #define ENC2_MAP    0
+#define ENC_DETENT  4               // counts per detent (4: one quadrature cycle)
+#define ENC_FILTER  15              // input filter (0: off, 15: 8 samples at fDTS/32)
+#define ENC_CKD     TIM_CKD_1       // filter clock fDTS (TIM_CKD_1: F_CPU / 4)
 
 // Encoder Functions
 void ENC1_init(void);
 void ENC1_set(uint16_t cur, uint16_t max);
 uint16_t ENC1_get(void);
+int8_t ENC1_step(void);
 
 void ENC2_init(void);
 void ENC2_set(uint16_t cur, uint16_t max);
 uint16_t ENC2_get(void);
+int8_t ENC2_step(void);
 
 #ifdef __cplusplus
 };
@@ -0,0 +1,86 @@
+// ===================================================================================
+// Key Edge Capture using Timer2 Input Capture for CH32V003                   * v1.0 *
+// ===================================================================================
+// 2024 by Stefan Wagner:   https://github.com/wagiminator
+
+#include "key_cap.h"
+#include "usb_descr.h"
+
+#define CAP_VTF_SLOT      (RV003USB_VTF_SLOT ^ 1) // VTF slot not used by USB
+
+volatile uint8_t  CAP_flag[2];            // first edge captured
+volatile uint8_t  CAP_extra[2];           // further edge captured (bounce)
+volatile uint32_t CAP_stamp[2];           // SysTick time of first edge
+
+void TIM2_IRQHandler(void) __attribute__((interrupt));
+
+// Init timer2 input capture on key 4 (PD4, CH1) and key 6 (PD3, CH2)
+void CAP_init(void) {
+  RCC->APB2PCENR |= RCC_AFIOEN;           // enable auxiliary I/O functions
+  RCC->APB1PCENR |= RCC_TIM2EN;           // enable timer2 module
+  AFIO->PCFR1    &= ~((uint32_t)0b11<<8); // no remap: CH1 on PD4, CH2 on PD3
+  TIM2->PSC       = DLY_US_TIME - 1;      // count microseconds
+  TIM2->ATRLR     = 0xffff;               // free running
+  TIM2->CHCTLR1   = TIM_CC1S_0 | TIM_IC1F_0 | TIM_IC1F_1   // IC1 on TI1, filter N=8
+                  | TIM_CC2S_0 | TIM_IC2F_0 | TIM_IC2F_1;  // IC2 on TI2, filter N=8
+  TIM2->CCER      = TIM_CC1E | TIM_CC1P   // capture falling edges (key pressed)
+                  | TIM_CC2E | TIM_CC2P;
+  TIM2->SWEVGR    = TIM_UG;               // load prescaler
+  TIM2->INTFR     = 0;                    // clear flags
+  TIM2->DMAINTENR = TIM_CC1IE | TIM_CC2IE;// enable capture interrupts
+  TIM2->CTLR1     = TIM_CEN;              // start timer
+  NVIC_SetPriority(TIM2_IRQn, 0x80);      // low priority (USB must preempt)
+  SetVTFIRQ((uint32_t)TIM2_IRQHandler, TIM2_IRQn, CAP_VTF_SLOT, ENABLE); // no table fetch
+  NVIC_EnableIRQ(TIM2_IRQn);
+}
+
+// Get SysTick time of the earliest captured edge of keys
+uint32_t CAP_first(uint8_t keys) {
+  if(!(keys & CAP_KEY_CH1) || !CAP_flag[0]) return CAP_stamp[1];
+  if(!(keys & CAP_KEY_CH2) || !CAP_flag[1]) return CAP_stamp[0];
+  return ((int32_t)(CAP_stamp[0] - CAP_stamp[1]) < 0) ? CAP_stamp[0] : CAP_stamp[1];
+}
+
+// Arm capture of the next edge of keys (state: bit n-1 set if key n is pressed),
+// returns keys that bounced (further edges after the first one)
+uint8_t CAP_arm(uint8_t keys, uint8_t state) {
+  uint8_t bounced = 0;
+  if(keys & CAP_KEY_CH1) {
+    if(CAP_extra[0]) bounced |= CAP_KEY_CH1;
+    if(state & CAP_KEY_CH1) TIM2->CCER &= ~TIM_CC1P;  // pressed: wait for rising edge
+    else                    TIM2->CCER |=  TIM_CC1P;  // released: wait for falling edge
+    CAP_extra[0] = 0;
+    CAP_flag[0]  = 0;
+  }
+  if(keys & CAP_KEY_CH2) {
+    if(CAP_extra[1]) bounced |= CAP_KEY_CH2;
+    if(state & CAP_KEY_CH2) TIM2->CCER &= ~TIM_CC2P;
+    else                    TIM2->CCER |=  TIM_CC2P;
+    CAP_extra[1] = 0;
+    CAP_flag[1]  = 0;
+  }
+  return bounced;
+}
+
+// Timer2 interrupt: convert capture values into SysTick time
+void TIM2_IRQHandler(void) {
+  uint16_t flags = TIM2->INTFR;
+  uint16_t cap;
+  if(flags & TIM_CC1IF) {
+    cap = TIM2->CH1CVR;                   // reading clears the flag
+    if(CAP_flag[0]) CAP_extra[0] = 1;     // not the first edge: bounce
+    else {
+      CAP_stamp[0] = STK->CNT - (uint32_t)(uint16_t)(TIM2->CNT - cap) * DLY_US_TIME;
+      CAP_flag[0]  = 1;
+    }
+  }
+  if(flags & TIM_CC2IF) {
+    cap = TIM2->CH2CVR;
+    if(CAP_flag[1]) CAP_extra[1] = 1;
+    else {
+      CAP_stamp[1] = STK->CNT - (uint32_t)(uint16_t)(TIM2->CNT - cap) * DLY_US_TIME;
+      CAP_flag[1]  = 1;
+    }
+  }
+  TIM2->INTFR = (uint16_t)~(flags & (TIM_CC1OF | TIM_CC2OF)); // clear overcapture
+}
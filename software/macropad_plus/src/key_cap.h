@@ -0,0 +1,62 @@
+// ===================================================================================
+// Key Edge Capture using Timer2 Input Capture for CH32V003                   * v1.0 *
+// ===================================================================================
+//
+// This library timestamps the edges of keys that are connected to capture inputs
+// of timer2 in hardware with microsecond resolution, independent of how late the
+// main loop gets to scan the keys (e.g. while the CPU is busy in the USB interrupt).
+//
+// Functions available:
+// --------------------
+// CAP_init()               init timer2 input capture on key 4 (PD4) and key 6 (PD3)
+// CAP_edges()              get keys with a captured edge since last arm (bit n-1: key n)
+// CAP_first(keys)          get SysTick time of the earliest captured edge of keys
+// CAP_arm(keys, state)     arm capture of the next edge of keys, returns bounced keys
+//
+// Notes:
+// ------
+// - Timer2 counts microseconds (16-bit). The interrupt converts the capture value
+//   into SysTick time, so captured edges can be compared with TIME_ticks(). It has
+//   low priority, the USB interrupt preempts it. It is entered via the VTF slot
+//   that is not used by the USB handler (no vector table fetch).
+// - Only the first edge after arming is timestamped. Further edges of the same
+//   polarity mean that the contact bounced, these keys are returned by CAP_arm().
+// - The expected edge follows the key state passed to CAP_arm(): falling (press)
+//   for a released key, rising (release) for a pressed key.
+// - The scan task starts the debounce window of a captured key at the captured
+//   edge (DEB_setStart()), not at the scan that saw it. Bounces after the first
+//   edge are not timestamped, they restart the window at scan time.
+// - The input filter suppresses glitches shorter than 8 system clock cycles.
+// - Key 5 (PD2) is on TIM1_CH1, but timer1 reads the rotary encoder, so key 5 is
+//   not captured.
+// - Timer2 is no longer available for other functionalities (e.g. ENC2).
+//
+// 2024 by Stefan Wagner:   https://github.com/wagiminator
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "system.h"
+
+// Captured Keys (bit n-1: key n)
+#define CAP_KEY_CH1       0x08          // key 4 on PD4 (TIM2_CH1)
+#define CAP_KEY_CH2       0x20          // key 6 on PD3 (TIM2_CH2)
+#define CAP_KEYS          (CAP_KEY_CH1 | CAP_KEY_CH2)
+
+// Capture Functions
+#define CAP_edges()       ((CAP_flag[0] ? CAP_KEY_CH1 : 0) | (CAP_flag[1] ? CAP_KEY_CH2 : 0))
+void     CAP_init(void);
+uint32_t CAP_first(uint8_t keys);
+uint8_t  CAP_arm(uint8_t keys, uint8_t state);
+
+// Capture State (written by interrupt)
+extern volatile uint8_t  CAP_flag[2];   // first edge captured
+extern volatile uint8_t  CAP_extra[2];  // further edge captured (bounce)
+extern volatile uint32_t CAP_stamp[2];  // SysTick time of first edge
+
+#ifdef __cplusplus
+};
+#endif
@@ -0,0 +1,86 @@
+// ===================================================================================
+// Per-Key Debouncing for CH32V003                                            * v1.0 *
+// ===================================================================================
+// 2024 by Stefan Wagner:   https://github.com/wagiminator
+
+#include "key_deb.h"
+
+// Algorithm and window of each key, generated from KEY_DEBOUNCE
+#define DEB_ONE(n, alg, win)       + 1
+#define DEB_ALGENTRY(n, alg, win)  [(n) - 1] = alg,
+#define DEB_WINENTRY(n, alg, win)  [(n) - 1] = win,
+static const uint8_t DEB_alg[KEYS_COUNT] = { KEY_DEBOUNCE(DEB_ALGENTRY) };
+const uint8_t DEB_win[KEYS_COUNT] = { KEY_DEBOUNCE(DEB_WINENTRY) };
+_Static_assert((0 KEY_DEBOUNCE(DEB_ONE)) == KEYS_COUNT, "one KEY_DEBOUNCE entry per key");
+
+KEYS_mask_t DEB_now;                      // debounced key states
+KEYS_mask_t DEB_busy;                     // keys with a running window
+KEYS_mask_t DEB_bounce;                   // keys with rejected edges on last update
+KEYS_mask_t DEB_start;                    // keys with a window started on last update
+KEYS_mask_t DEB_raw;                      // raw key states of last update
+uint16_t    DEB_time[KEYS_COUNT];         // time of last edge (ms)
+uint8_t     DEB_count[KEYS_COUNT];        // integrator counts
+DEB_stats_t DEB_stats[KEYS_COUNT];        // switch statistics
+uint8_t     DEB_extra[KEYS_COUNT];        // window extensions by chatter
+
+// Update statistics of key i on a raw edge, returns effective window
+static uint8_t DEB_edge(uint8_t i, uint8_t busy, uint16_t ms) {
+  DEB_stats_t *s = &DEB_stats[i];
+  uint16_t gap   = ms - DEB_time[i];      // time since last edge
+  uint8_t  win   = DEB_window(i);
+  if(gap > 0xff) gap = 0xff;
+  if(!gap)       gap = 1;
+  if(!s->minGap || gap < s->minGap) s->minGap = gap;
+  if(busy) s->bounces++;                  // rejected by the window
+  else if(gap < DEB_CHATTER * win) {      // shortly after the window: chatter
+    if(s->chatter < 0xff) s->chatter++;
+    if(DEB_extra[i] < DEB_EXTRA_MAX) win = DEB_win[i] + ++DEB_extra[i]; // lengthen window
+  }
+  DEB_time[i] = ms;
+  return win;
+}
+
+// Debounce raw key states (bit n-1: key n pressed), returns keys changed
+KEYS_mask_t DEB_update(KEYS_mask_t raw, uint16_t ms) {
+  KEYS_mask_t edges  = raw ^ DEB_raw;     // raw edges since last update
+  KEYS_mask_t todo   = edges | DEB_busy;  // keys to process
+  KEYS_mask_t change = 0;
+  KEYS_mask_t b;
+  uint8_t i, win;
+
+  DEB_raw    = raw;
+  DEB_bounce = edges & DEB_busy;          // edges within a running window
+  DEB_start  = edges & ~DEB_busy;         // first edges, start a window
+  while(todo) {                           // walk active keys only
+    i = __builtin_ctz(todo);
+    b = (KEYS_mask_t)1 << i;
+    todo &= todo - 1;
+    if(edges & b) win = DEB_edge(i, DEB_busy & b, ms);
+    else          win = DEB_window(i);
+
+    // Integrator: count towards the raw state, change at the limits
+    if(DEB_alg[i] == DEB_INTEGRATE) {
+      if(raw & b) { if(DEB_count[i] < win) DEB_count[i]++; }
+      else        { if(DEB_count[i]) DEB_count[i]--; }
+      if(DEB_count[i] == ((DEB_now & b) ? 0 : win)) change |= b;
+      if(DEB_count[i] == ((raw & b) ? win : 0)) DEB_busy &= ~b;
+      else DEB_busy |= b;
+      continue;
+    }
+
+    // Window: restart on every edge, evaluate after the contact was quiet
+    if(edges & b) {
+      if(!(DEB_busy & b) && (DEB_alg[i] == DEB_EAGER) && (raw & b)) change |= b;
+      DEB_busy |= b;
+    }
+    else if((uint16_t)(ms - DEB_time[i]) >= win) {
+      DEB_busy &= ~b;                     // window over
+      if((raw ^ DEB_now) & b) change |= b;      // report if state differs
+    }
+  }
+  DEB_now ^= change;
+
+  // Count presses
+  for(b = change & DEB_now; b; b &= b - 1) DEB_stats[__builtin_ctz(b)].presses++;
+  return change;
+}
@@ -0,0 +1,98 @@
+// ===================================================================================
+// Per-Key Debouncing for CH32V003                                            * v1.0 *
+// ===================================================================================
+//
+// This library debounces the raw key states of the key scanner. Algorithm and window
+// are selected per key by the KEY_DEBOUNCE list in config.h, so latency can be traded
+// against reliability for each switch type.
+//
+// Functions available:
+// --------------------
+// DEB_update(raw, ms)      debounce raw key states, returns keys changed
+// DEB_state()              get debounced key states (bit n-1: key n pressed)
+// DEB_pending()            get keys with a running debounce window
+// DEB_bounced()            get keys with edges rejected by the last update
+// DEB_window(i)            get effective window of key i (0: key 1)
+// DEB_started()            get keys whose window started on the last update
+// DEB_setStart(i, ms)      move window start of key i to an earlier edge time
+//
+// Algorithms:
+// -----------
+// DEB_EAGER                press is reported on the first edge, release after the
+//                          contact was quiet for the window (lowest latency)
+// DEB_DEFER                both edges are reported after the contact was quiet for
+//                          the window (noisy switches, no false presses on glitches)
+// DEB_INTEGRATE            samples are integrated, the state changes when the counter
+//                          reaches 0 or the window (window in scans)
+//
+// Notes:
+// ------
+// - DEB_update() must be called on every key scan. Windows of DEB_EAGER and
+//   DEB_DEFER are in milliseconds and independent of the scan period, the window
+//   of DEB_INTEGRATE counts scans (1ms while keys are active).
+// - Only keys with an edge or a running window are processed, so idle keys cost
+//   nothing.
+// - The window starts at the time passed to DEB_update() with the first edge. If
+//   the edge was timestamped more precisely (e.g. by input capture), the start can
+//   be corrected with DEB_setStart() for the keys returned by DEB_started().
+// - An edge within a running window is a rejected bounce. These keys are returned
+//   by DEB_bounced() until the next update.
+// - Switch statistics are kept per key in DEB_stats[] for wear detection: presses,
+//   rejected bounces, shortest interval between two raw edges and chatter events.
+//   Chatter is an edge that arrives less than DEB_CHATTER windows after the last
+//   one, but after the window was over, so it passed as a new key event (e.g. a
+//   double-typed character). Each chatter event lengthens the window of this key
+//   by one millisecond (scan) up to DEB_EXTRA_MAX, worn switches thus get longer
+//   windows, while good ones keep the low latency.
+// - The statistics are kept in SRAM and cleared on reset. They are not written to
+//   flash, because erasing a flash page stalls the CPU for milliseconds, which the
+//   bit-banged USB does not tolerate.
+//
+// 2024 by Stefan Wagner:   https://github.com/wagiminator
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "key_scan.h"
+
+// Debounce Algorithms
+#define DEB_EAGER         0             // eager press, deferred release
+#define DEB_DEFER         1             // deferred press and release
+#define DEB_INTEGRATE     2             // integrator
+
+// Chatter Parameters
+#define DEB_CHATTER       2             // edges within this many windows are chatter
+#define DEB_EXTRA_MAX     20            // max window extension per key
+
+// Switch Statistics (per key, published in the key statistics report)
+typedef struct {
+  uint16_t presses;                     // debounced presses (wraps)
+  uint16_t bounces;                     // edges rejected within the window (wraps)
+  uint8_t  minGap;                      // shortest interval between raw edges in ms
+  uint8_t  chatter;                     // edges shortly after the window (saturates)
+} DEB_stats_t;
+
+// Debounce Functions
+#define DEB_state()       (DEB_now)
+#define DEB_pending()     (DEB_busy)
+#define DEB_bounced()     (DEB_bounce)
+#define DEB_window(i)     (DEB_win[i] + DEB_extra[i])
+#define DEB_started()     (DEB_start)
+#define DEB_setStart(i, ms) (DEB_time[i] = (ms))
+KEYS_mask_t DEB_update(KEYS_mask_t raw, uint16_t ms);
+
+extern KEYS_mask_t DEB_now;             // debounced key states
+extern KEYS_mask_t DEB_busy;            // keys with a running window
+extern KEYS_mask_t DEB_bounce;          // keys with rejected edges on last update
+extern KEYS_mask_t DEB_start;           // keys with a window started on last update
+extern uint16_t    DEB_time[KEYS_COUNT];  // time of last edge (ms)
+extern DEB_stats_t DEB_stats[KEYS_COUNT]; // switch statistics
+extern uint8_t     DEB_extra[KEYS_COUNT]; // window extensions by chatter
+extern const uint8_t DEB_win[KEYS_COUNT]; // configured windows
+
+#ifdef __cplusplus
+};
+#endif
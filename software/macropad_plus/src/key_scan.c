@@ -0,0 +1,129 @@
+// ===================================================================================
+// Key Scanning using GPIO Port Snapshots for CH32V003                        * v1.0 *
+// ===================================================================================
+// 2024 by Stefan Wagner:   https://github.com/wagiminator
+
+#include "key_scan.h"
+
+_Static_assert((KEYS_PORTS & (KEYS_PORTS - 1)) == 0, "all keys/columns must be on the same GPIO port");
+_Static_assert(KEYS_COUNT <= 32, "up to 32 keys are supported");
+_Static_assert((PIN_ENC_A >> 3) == (PIN_ENC_SW >> 3), "encoder A and switch must be on the same GPIO port");
+
+KEYS_mask_t KEYS_now;                     // raw key states (bit n-1: key n pressed)
+uint8_t     KEYS_encNow;                  // encoder pins low
+uint16_t    KEYS_scanMax;                 // longest scan in system ticks
+
+#if KEY_MATRIX
+// ===================================================================================
+// Key Matrix
+// ===================================================================================
+_Static_assert(KEYS_COLS_N <= 8, "up to 8 columns are supported");
+
+// Column port bit -> column bit, generated from KEY_COLS
+#define KEYS_COLENTRY(n, pin) [(pin) & 7] = 1 << ((n) - 1),
+static const uint8_t KEYS_colmap[8] = { KEY_COLS(KEYS_COLENTRY) };
+
+uint8_t     KEYS_row[KEYS_ROWS_N];        // pressed columns per row (raw)
+
+// Set rows to open-drain low (idle), columns to input pullup
+#define KEYS_ROWINIT(n, pin)  PIN_output_OD(pin); PIN_low(pin);
+#define KEYS_COLINIT(n, pin)  PIN_input_PU(pin);
+void KEYS_init(void) {
+  KEY_ROWS(KEYS_ROWINIT)
+  KEY_COLS(KEYS_COLINIT)
+}
+
+// Read pressed columns of the selected row
+static uint8_t KEYS_readRow(void) {
+  uint8_t port = ~KEYS_GPIO->INDR & KEYS_MASK;          // one snapshot of all columns
+  uint8_t cols = 0;
+  while(port) {                                         // walk pressed columns only
+    cols |= KEYS_colmap[__builtin_ctz(port)];
+    port &= port - 1;
+  }
+  return cols;
+}
+
+// Sample keys, returns keys changed (bit n-1: key n)
+#define KEYS_ROWRELEASE(n, pin) PIN_high(pin);
+#define KEYS_ROWSCAN(n, pin)                                                    \
+  PIN_low(pin);                                         /* select row */       \
+  DLY_ticks(KEY_SETTLE_US * DLY_US_TIME);               /* let columns settle */ \
+  KEYS_row[(n) - 1] = KEYS_readRow();                                           \
+  PIN_high(pin);                                        /* release row */
+#define KEYS_ROWIDLE(n, pin)    PIN_low(pin);
+KEYS_mask_t KEYS_scan(void) {
+  uint32_t start = STK->CNT;
+  KEYS_mask_t raw = 0;
+  KEYS_mask_t change;
+  uint8_t r, q, row;
+
+  // Scan rows one by one, then hold all rows low again
+  KEY_ROWS(KEYS_ROWRELEASE)
+  DLY_ticks(KEY_SETTLE_US * DLY_US_TIME);
+  KEY_ROWS(KEYS_ROWSCAN)
+  KEY_ROWS(KEYS_ROWIDLE)
+  KEYS_encNow = ~KEYS_ENC_GPIO->INDR & KEYS_ENC_MASK;
+
+  // Assemble raw key states, keep last state of rows with possible ghost keys
+  // (KEYS_row[] stays unmodified, so every row is tested against the snapshot)
+  for(r=0; r<KEYS_ROWS_N; r++) {
+    row = KEYS_row[r];
+    #if !KEY_DIODES
+    if(row & (row - 1)) {                               // more than one key in row?
+      for(q=0; q<KEYS_ROWS_N; q++) {
+        if((q != r) && (KEYS_row[q] & KEYS_row[r])) {   // shares a column?
+          row = (KEYS_now >> (r * KEYS_COLS_N)) & ((1 << KEYS_COLS_N) - 1);
+          break;
+        }
+      }
+    }
+    #else
+    (void)q;
+    #endif
+    raw |= (KEYS_mask_t)row << (r * KEYS_COLS_N);
+  }
+  change   = raw ^ KEYS_now;                            // raw changes
+  KEYS_now = raw;
+
+  // Measure scan time
+  start = STK->CNT - start;
+  if(start > KEYS_scanMax) KEYS_scanMax = start;
+  return change;
+}
+
+#else
+// ===================================================================================
+// Direct Key Pins
+// ===================================================================================
+
+// Port bit -> key bit, generated from KEY_PINS
+#define KEYS_MAPENTRY(n, pin, led) [(pin) & 7] = 1 << ((n) - 1),
+static const uint8_t KEYS_map[8] = { KEY_PINS(KEYS_MAPENTRY) };
+
+uint8_t KEYS_last;                        // port snapshot of last scan (1: low)
+
+// Set key pins to input pullup
+#define KEYS_INIT(n, pin, led) PIN_input_PU(pin);
+void KEYS_init(void) {
+  KEY_PINS(KEYS_INIT)
+}
+
+// Sample keys, returns keys changed (bit n-1: key n)
+KEYS_mask_t KEYS_scan(void) {
+  uint32_t start = STK->CNT;
+  uint8_t port   = ~KEYS_GPIO->INDR & KEYS_MASK;        // one snapshot of all keys
+  uint8_t diff   = port ^ KEYS_last;                    // changed port bits
+  uint8_t change = 0;
+  KEYS_encNow    = ~KEYS_ENC_GPIO->INDR & KEYS_ENC_MASK;
+  KEYS_last      = port;
+  while(diff) {                                         // walk changed bits only
+    change |= KEYS_map[__builtin_ctz(diff)];
+    diff   &= diff - 1;
+  }
+  KEYS_now ^= change;
+  start = STK->CNT - start;
+  if(start > KEYS_scanMax) KEYS_scanMax = start;
+  return change;
+}
+#endif
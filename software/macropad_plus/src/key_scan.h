@@ -0,0 +1,104 @@
+// ===================================================================================
+// Key Scanning using GPIO Port Snapshots for CH32V003                        * v1.0 *
+// ===================================================================================
+//
+// This library samples all keys with a single read of the GPIO input register per
+// scan (per row in matrix mode). The pin assignment is taken from the KEY_PINS or
+// KEY_ROWS/KEY_COLS lists in config.h at compile time.
+//
+// Functions available:
+// --------------------
+// KEYS_init()              set up key pins
+// KEYS_scan()              sample keys, returns keys changed (bit n-1: key n)
+// KEYS_state()             get raw key states of last scan (bit n-1: key n pressed)
+// KEYS_enc()               get encoder pins of last scan (KEYS_ENC_A/KEYS_ENC_SW low)
+// KEYS_active()            check if any key, encoder A or encoder switch is low
+//
+// Notes:
+// ------
+// - Keys and encoder pins are sampled coherently, with one read of the key port
+//   and one read of the encoder port.
+// - The port snapshot is compared with the previous one, only the changed bits are
+//   mapped to key numbers. So the scan cost depends on the number of changes, not
+//   on the number of keys.
+// - Keys must switch to ground (active low).
+// - Matrix mode (KEY_MATRIX = 1): between scans all rows are held low, so a pressed
+//   key pulls its column low and KEYS_active() works as with direct pins. A scan
+//   releases the rows, selects them one by one and reads all columns at once.
+//   Without diodes (KEY_DIODES = 0), a row with more than one pressed key that
+//   shares a column with another pressed row may contain ghost keys. Such rows
+//   keep their last state until the pattern becomes unambiguous.
+// - The key states are raw samples, they are debounced per key by key_deb.
+// - The scan time is bounded by KEYS_SCAN_US at compile time (added to the budget
+//   of the scan task) and measured in KEYS_scanMax (system ticks, longest scan
+//   since start), which is published in the counter report (see perf_cnt.h).
+//
+// 2024 by Stefan Wagner:   https://github.com/wagiminator
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <config.h>
+#include "system.h"
+#include "gpio.h"
+
+#define KEYS_PORT_OF(ports)   ((ports) == 1 ? GPIOA : (ports) == 2 ? GPIOC : GPIOD)
+
+#if KEY_MATRIX
+// Compile-time pin metadata from KEY_ROWS/KEY_COLS
+#define KEYS_LINEONE(n, pin)  + 1
+#define KEYS_LINEBIT(n, pin)  | (1 << ((pin) & 7))
+#define KEYS_LINEPORT(n, pin) | (1 << ((pin) >> 3))
+#define KEYS_ROWS_N           (0 KEY_ROWS(KEYS_LINEONE))  // number of rows
+#define KEYS_COLS_N           (0 KEY_COLS(KEYS_LINEONE))  // number of columns
+#define KEYS_COUNT            (KEYS_ROWS_N * KEYS_COLS_N) // number of keys
+#define KEYS_MASK             (0 KEY_COLS(KEYS_LINEBIT))  // column bits in port
+#define KEYS_PORTS            (0 KEY_COLS(KEYS_LINEPORT)) // ports used (A:1, C:2, D:4)
+#define KEYS_SCAN_US          ((KEYS_ROWS_N + 1) * (KEY_SETTLE_US + 1)) // scan time bound
+#if INPUT_CAPTURE
+  #error Key edge capture (INPUT_CAPTURE) needs direct key pins (KEY_MATRIX = 0)!
+#endif
+#else
+// Compile-time pin metadata from KEY_PINS
+#define KEYS_PORTBIT(n, pin, led) | (1 << ((pin) & 7))
+#define KEYS_PORTNUM(n, pin, led) | (1 << ((pin) >> 3))
+#define KEYS_ONE(n, pin, led)     + 1
+#define KEYS_MASK             (0 KEY_PINS(KEYS_PORTBIT))  // key bits in port
+#define KEYS_PORTS            (0 KEY_PINS(KEYS_PORTNUM))  // ports used (A:1, C:2, D:4)
+#define KEYS_COUNT            (0 KEY_PINS(KEYS_ONE))      // number of keys
+#define KEYS_SCAN_US          1                           // scan time bound
+#endif
+#define KEYS_GPIO             KEYS_PORT_OF(KEYS_PORTS)
+
+// Key state type (bit n-1: key n)
+#if   KEYS_COUNT <= 8
+typedef uint8_t  KEYS_mask_t;
+#elif KEYS_COUNT <= 16
+typedef uint16_t KEYS_mask_t;
+#else
+typedef uint32_t KEYS_mask_t;
+#endif
+
+// Encoder pins read with the keys
+#define KEYS_ENC_A            (1 << (PIN_ENC_A  & 7))
+#define KEYS_ENC_SW           (1 << (PIN_ENC_SW & 7))
+#define KEYS_ENC_MASK         (KEYS_ENC_A | KEYS_ENC_SW)
+#define KEYS_ENC_GPIO         KEYS_PORT_OF(1 << (PIN_ENC_A >> 3))
+
+// Key Functions
+#define KEYS_state()          (KEYS_now)
+#define KEYS_enc()            (KEYS_encNow)
+#define KEYS_active()         ((~KEYS_GPIO->INDR & KEYS_MASK) || (~KEYS_ENC_GPIO->INDR & KEYS_ENC_MASK))
+void        KEYS_init(void);
+KEYS_mask_t KEYS_scan(void);
+
+extern KEYS_mask_t KEYS_now;            // raw key states (bit n-1: key n pressed)
+extern uint8_t     KEYS_encNow;         // encoder pins low (KEYS_ENC_A/KEYS_ENC_SW)
+extern uint16_t    KEYS_scanMax;        // longest scan in system ticks
+
+#ifdef __cplusplus
+};
+#endif
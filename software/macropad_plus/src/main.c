@@ -30,6 +30,11 @@
 // - Connect the board via USB to your PC. It should be detected as a HID device with
 //   keyboard and mouse interface.
 // - Press a macro key or turn the knob and see what happens.
+// - While the host is suspended, the NeoPixels stay off. A key press or a step of
+//   the knob wakes up the host (if it has enabled remote wakeup). Short actions
+//   that end before the host has resumed are not seen by the host.
+// - Runtime counters can be read from the host as HID feature report with ID 4,
+//   e.g. via hidraw on Linux (see src/perf_cnt.h for the layout).
 
 
 // ===================================================================================
@@ -37,221 +42,314 @@
 // ===================================================================================
 #include <config.h>                               // user configurations
 #include <system.h>                               // system functions
+#include <time_stk.h>                             // time base and software timers
+#include <scheduler.h>                            // task scheduler
 #include <gpio.h>                                 // GPIO functions
+#include <key_scan.h>                             // key port snapshots
+#include <key_deb.h>                              // per-key debouncing
 #include <neo_spi.h>                              // NeoPixel fuctions
+#include <vdd_mon.h>                              // supply voltage monitor
 #include <encoder_tim.h>                          // rotary encoder functions
 #include <usb_composite.h>                        // USB HID composite functions
+#include <perf_cnt.h>                             // performance counters
+#include <key_cap.h>                              // key edge capture
 #include <macros.h>                               // user defined macros
 
+// Encoder pins in config.h must match the timer1 mapping in encoder_tim.h
+_Static_assert(ENC1_MAP == 2 && PIN_ENC_A == PC4 && PIN_ENC_B == PC7,
+               "encoder A/B must be on PC4/PC7 (timer1 channels 1/2 with ENC1_MAP 2)");
+
 // ===================================================================================
 // NeoPixel Functions
 // ===================================================================================
 
-uint8_t neoencoder = 0;                           // state of NeoPixel ring rotation
+uint16_t neoencoder = 0;                          // hue of NeoPixel ring rotation (8.8)
 
 // Update NeoPixel ring colors
 void NEO_encoder_update(void) {
-  uint8_t i, j;
-  j = neoencoder;
+  uint8_t  i;
+  uint16_t j = neoencoder;
   for(i=6; i<18; i++) {
-    NEO_writeHue(i, j, NEO_BRIGHT_ENC);
-    j += 16;
-    if(j >= 192) j -= 192;
+    NEO_writeHSV(i, j >> 8, NEO_SAT_ENC, NEO_BRIGHT_ENC);
+    j += 0x1555;                                  // 1/12 of the color wheel
   }
   NEO_update();
 }
 
 // Rotate NeoPixel ring clockwise
 void NEO_encoder_cw(void) {
-  neoencoder += 8;
-  if(neoencoder >= 192) neoencoder -= 192;
+  neoencoder += 0x0AAB;                           // 1/24 of the color wheel
   NEO_encoder_update();
 }
 
 // Rotate NeoPixel ring counter-clockwise
 void NEO_encoder_ccw(void) {
-  neoencoder -= 8;
-  if(neoencoder >= 192) neoencoder -= 64;
+  neoencoder -= 0x0AAB;                           // 1/24 of the color wheel
   NEO_encoder_update();
 }
 
 // ===================================================================================
-// Main Function
+// Tasks
 // ===================================================================================
-int main(void) {
-  // Variables
-  uint8_t key1last = 0;                           // last state of key 1
-  uint8_t key2last = 0;                           // last state of key 2
-  uint8_t key3last = 0;                           // last state of key 3
-  uint8_t key4last = 0;                           // last state of key 4
-  uint8_t key5last = 0;                           // last state of key 5
-  uint8_t key6last = 0;                           // last state of key 6
-  uint8_t isSwitchPressed = 0;                    // state of rotary encoder switch
 
-  // Setup pins for keys and encoder
-  PIN_input_PU(PIN_KEY1);
-  PIN_input_PU(PIN_KEY2);
-  PIN_input_PU(PIN_KEY3);
-  PIN_input_PU(PIN_KEY4);
-  PIN_input_PU(PIN_KEY5);
-  PIN_input_PU(PIN_KEY6);
-  PIN_input_PU(PIN_ENC_SW);
-  PIN_input_PU(PIN_ENC_A);
-  PIN_input_PU(PIN_ENC_B);
+KEYS_mask_t keystate   = 0;                       // state of keys (bit n-1: key n)
+KEYS_mask_t keychanged = 0;                       // keys changed since last dispatch
+uint8_t isSwitchPressed = 0;                      // state of rotary encoder switch
+uint8_t encphase = 0;                             // 0: idle, 1: cw, 2: ccw, 3: pause
+uint8_t suspended = 0;                            // USB bus suspended (LEDs stay off)
+uint16_t encdue;                                  // end of encoder phase (ms)
+uint32_t inputlast = 0;                           // time of last input activity
 
-  // Setup NeoPixels
-  NEO_init();                                     // init NeoPixels
-  NEO_clearAll();                                 // clear NeoPixels
+// Check if any key, the encoder switch or the encoder is active
+uint8_t INPUT_active(void) {
+  static uint16_t enccount = 0;                   // encoder count of last check
+  uint16_t count = ENC1_get();
+  uint8_t  moved = (count != enccount);           // turned, even between detents
+  enccount = count;
+  return KEYS_active() || !PIN_read(PIN_ENC_B) || moved;
+}
 
-  // Init USB HID device
-  HID_init();                                     // init USB HID device
-  NEO_encoder_update();                           // set NeoPixel ring for encoder
+// Set polling period of input tasks (scan, dispatch, macro)
+extern TASK_t tasks[];
+void INPUT_setPeriod(uint16_t period) {
+  TASK_setPeriod(&tasks[0], period);
+  TASK_setPeriod(&tasks[1], period);
+  TASK_setPeriod(&tasks[2], period);
+}
 
-  // Loop
-  while(1) {
+// Wake up input tasks immediately (if in slow polling mode)
+void INPUT_wake(void) {
+  if(tasks[0].period == 1) return;
+  TASK_release(&tasks[0]);
+  TASK_release(&tasks[1]);
+  TASK_release(&tasks[2]);
+}
 
-    // Handle key 1
-    // ------------
-    if((!PIN_read(PIN_KEY1)) != key1last) {       // key state changed?
-      key1last = !key1last;                       // update last state flag
-      if(key1last) {                              // key was pressed?
-        NEO_writeHue(0, NEO_KEY1, NEO_BRIGHT_KEYS);    // light up corresponding NeoPixel
-        NEO_update();                             // update pixels
-        KEY1_PRESSED();                           // take proper action
-      }
-      else {                                      // key was released?
-        NEO_clearPixel(0);                        // light up corresponding NeoPixel
-        NEO_update();                             // update pixels
-        KEY1_RELEASED();                          // take proper action
-      }
-    }
-    else if(key1last) {                           // key still being pressed?
-      KEY1_HOLD();                                // take proper action
-    }
+// Count number of set bits
+uint8_t popcount(uint32_t x) {
+  uint8_t n = 0;
+  for(; x; x &= x - 1) n++;
+  return n;
+}
 
-    // Handle key 2
-    // ------------
-    if((!PIN_read(PIN_KEY2)) != key2last) {       // key state changed?
-      key2last = !key2last;                       // update last state flag
-      if(key2last) {                              // key was pressed?
-        NEO_writeHue(1, NEO_KEY2, NEO_BRIGHT_KEYS);    // light up corresponding NeoPixel
-        NEO_update();                             // update pixels
-        KEY2_PRESSED();                           // take proper action
-      }
-      else {                                      // key was released?
-        NEO_clearPixel(1);                        // light up corresponding NeoPixel
-        NEO_update();                             // update pixels
-        KEY2_RELEASED();                          // take proper action
-      }
-    }
-    else if(key2last) {                           // key still being pressed?
-      KEY2_HOLD();                                // take proper action
-    }
+// Scan task: sample and debounce keys
+void SCAN_task(void) {
+  uint32_t stamp = STK->CNT;                      // time of this scan
+  KEYS_mask_t change;
+  KEYS_mask_t state;
+  KEYS_mask_t bounced;
+  #if INPUT_CAPTURE
+  static uint8_t capchanged = 0;                  // keys changed since last arm
+  uint8_t captured = CAP_edges();                 // edges timestamped by timer2
+  uint8_t b;
+  #endif
+  KEYS_scan();                                    // port snapshot(s) of all keys
+  change       = DEB_update(KEYS_state(), TIME_ms()); // debounced key changes
+  state        = DEB_state();
+  bounced      = DEB_bounced();                   // edges rejected by debouncing
+  keychanged  |= change;                          // remember changes
+  keystate     = state;                           // update key states
+  PERF_event(popcount(change));                   // count key edges
+  #if INPUT_CAPTURE
+  for(b = captured & DEB_started(); b; b &= b - 1) // windows start at physical edge
+    DEB_setStart(__builtin_ctz(b), TIME_ms() - (STK->CNT - CAP_first(b & -b)) / (F_CPU / 1000));
+  if(captured & change) stamp = CAP_first(captured & change); // physical edge time
+  bounced     &= ~CAP_KEYS;                       // timer2 sees all their edges
+  capchanged  |= change & CAP_KEYS;
+  captured     = (captured | change) & CAP_KEYS & ~DEB_pending(); // window over
+  if(captured) {                                  // edge without change: glitch
+    bounced   |= CAP_arm(captured, state) | (captured & ~capchanged);
+    capchanged &= ~captured;
+  }
+  #endif
+  if(change) HID_markEdge(stamp);                 // start latency measurement
+  PERF_bounce(popcount(bounced));                 // count rejected edges
+  if(KEYS_state() || DEB_pending() || isSwitchPressed || encphase || (KEYS_enc() & KEYS_ENC_A))
+    inputlast = TIME_ms();
+  INPUT_setPeriod((TIME_ms() - inputlast) < INPUT_IDLE_TIMEOUT ? 1 : INPUT_IDLE_PERIOD);
+}
 
-    // Handle key 3
-    // ------------
-    if((!PIN_read(PIN_KEY3)) != key3last) {       // key state changed?
-      key3last = !key3last;                       // update last state flag
-      if(key3last) {                              // key was pressed?
-        NEO_writeHue(2, NEO_KEY3, NEO_BRIGHT_KEYS);    // light up corresponding NeoPixel
-        NEO_update();                             // update pixels
-        KEY3_PRESSED();                           // take proper action
-      }
-      else {                                      // key was released?
-        NEO_clearPixel(2);                        // light up corresponding NeoPixel
-        NEO_update();                             // update pixels
-        KEY3_RELEASED();                          // take proper action
-      }
-    }
-    else if(key3last) {                           // key still being pressed?
-      KEY3_HOLD();                                // take proper action
+// NeoPixel index of each key, generated from KEY_PINS (matrix: NeoPixel n-1)
+#if KEY_MATRIX
+#define KEY_LED(i)          (i)
+#else
+#define KEY_LEDENTRY(n, pin, led) [(n) - 1] = led,
+static const uint8_t KEY_led[KEYS_COUNT] = { KEY_PINS(KEY_LEDENTRY) };
+#define KEY_LED(i)          (KEY_led[i])
+#endif
+_Static_assert(sizeof(KEY_actions) / sizeof(KEY_action_t) == KEYS_COUNT, "one KEY_actions[] entry per key");
+
+uint16_t keyhold[KEYS_COUNT];                     // time of next hold action (ms)
+
+// Handle press or release of key i (0: key 1)
+void KEY_handle(uint8_t i, uint8_t pressed) {
+  const KEY_action_t *a = &KEY_actions[i];
+  uint8_t j;
+  if(pressed) {                                   // key was pressed?
+    if(!suspended)                                // NeoPixels stay off in suspend
+      NEO_writeHSV(KEY_LED(i), a->hue, NEO_SAT_KEYS, NEO_BRIGHT_KEYS); // light up NeoPixel
+    for(j=0; j<3 && a->chord[j]; j++) KBD_press(a->chord[j]);     // press chord
+    if(a->pressed) a->pressed();                  // take proper action
+    keyhold[i] = TIME_ms();                       // hold action from now on
+  }
+  else {                                          // key was released?
+    if(!suspended) NEO_clearPixel(KEY_LED(i));    // clear corresponding NeoPixel
+    for(j=3; j--; ) if(a->chord[j]) KBD_release(a->chord[j]);    // release chord
+    if(a->released) a->released();               // take proper action
+  }
+}
+
+// Dispatch task: handle key and encoder events
+void DISPATCH_task(void) {
+  KEYS_mask_t changed = keychanged;
+  uint16_t now = TIME_ms();
+  int8_t step;
+  uint8_t i;
+  keychanged = 0;
+
+  // Handle keys
+  // -----------
+  if(changed) {
+    while(changed) {                              // walk changed keys only
+      i = __builtin_ctz(changed);
+      KEY_handle(i, (keystate >> i) & 1);
+      changed &= changed - 1;
     }
+    NEO_update();                                 // update pixels
+  }
 
-    // Handle key 4
-    // ------------
-    if((!PIN_read(PIN_KEY4)) != key4last) {       // key state changed?
-      key4last = !key4last;                       // update last state flag
-      if(key4last) {                              // key was pressed?
-        NEO_writeHue(3, NEO_KEY4, NEO_BRIGHT_KEYS);    // light up corresponding NeoPixel
-        NEO_update();                             // update pixels
-        KEY4_PRESSED();                           // take proper action
-      }
-      else {                                      // key was released?
-        NEO_clearPixel(3);                        // light up corresponding NeoPixel
-        NEO_update();                             // update pixels
-        KEY4_RELEASED();                          // take proper action
-      }
+  // Handle rotary encoder (detents are counted by timer1, one action at a time)
+  // ---------------------
+  if(encphase && (int16_t)(now - encdue) >= 0) {  // phase over?
+    if(encphase == 1)      ENC_CW_RELEASED();     // take proper action
+    else if(encphase == 2) ENC_CCW_RELEASED();    // take proper action
+    encphase = (encphase == 3) ? 0 : 3;           // pause before next action
+    encdue   = now + ENC_HOLD_MS;
+  }
+  if(!encphase && (step = ENC1_step())) {         // encoder turned one detent?
+    uint32_t stamp = STK->CNT;
+    PERF_event(1);                                // count encoder step
+    HID_markEdge(stamp);                          // start latency measurement
+    if(step > 0) {                                // clockwise ?
+      ENC_CW_ACTION();                            // take proper action
+      if(!suspended) NEO_encoder_cw();            // rotate NeoPixels
+      encphase = 1;
     }
-    else if(key4last) {                           // key still being pressed?
-      KEY4_HOLD();                                // take proper action
+    else {                                        // counter-clockwise ?
+      ENC_CCW_ACTION();                           // take proper action
+      if(!suspended) NEO_encoder_ccw();           // rotate NeoPixels
+      encphase = 2;
     }
+    encdue = now + ENC_HOLD_MS;                   // release later, don't block
+  }
+  if(!isSwitchPressed && (KEYS_enc() & KEYS_ENC_SW)) {  // switch previously pressed?
+    ENC_SW_PRESSED();                             // take proper action
+    isSwitchPressed = 1;
+  }
+  else if(isSwitchPressed && !(KEYS_enc() & KEYS_ENC_SW)) { // switch previously released?
+    ENC_SW_RELEASED();                            // take proper action
+    isSwitchPressed = 0;                          // update switch state
+  }
+  HID_markEdge(0);                                // edge without report: discard
+}
 
-    // Handle key 5
-    // ------------
-    if((!PIN_read(PIN_KEY5)) != key5last) {       // key state changed?
-      key5last = !key5last;                       // update last state flag
-      if(key5last) {                              // key was pressed?
-        NEO_writeHue(4, NEO_KEY5, NEO_BRIGHT_KEYS);    // light up corresponding NeoPixel
-        NEO_update();                             // update pixels
-        KEY5_PRESSED();                           // take proper action
-      }
-      else {                                      // key was released?
-        NEO_clearPixel(4);                        // light up corresponding NeoPixel
-        NEO_update();                             // update pixels
-        KEY5_RELEASED();                          // take proper action
-      }
-    }
-    else if(key5last) {                           // key still being pressed?
-      KEY5_HOLD();                                // take proper action
+// Macro task: repeat hold actions and run software timers
+void MACRO_task(void) {
+  KEYS_mask_t held = keystate & ~keychanged;      // keys held, not yet dispatched
+  uint16_t now = TIME_ms();
+  uint8_t i;
+  while(held) {
+    i = __builtin_ctz(held);
+    if(KEY_actions[i].hold && (int16_t)(now - keyhold[i]) >= 0) {
+      KEY_actions[i].hold();                      // take hold action
+      keyhold[i] = now + KEY_actions[i].repeat;   // schedule next one
     }
+    held &= held - 1;
+  }
+  TMR_process();                                  // run expired software timers
+}
+
+// Render task: send pending NeoPixel frames
+void RENDER_task(void) {
+  NEO_refresh();                                  // send pending/dithering frames
+}
 
-    // Handle key 6
-    // ------------
-    if((!PIN_read(PIN_KEY6)) != key6last) {       // key state changed?
-      key6last = !key6last;                       // update last state flag
-      if(key6last) {                              // key was pressed?
-        NEO_writeHue(5, NEO_KEY6, NEO_BRIGHT_KEYS);    // light up corresponding NeoPixel
-        NEO_update();                             // update pixels
-        KEY6_PRESSED();                           // take proper action
-      }
-      else {                                      // key was released?
-        NEO_clearPixel(5);                        // light up corresponding NeoPixel
-        NEO_update();                             // update pixels
-        KEY6_RELEASED();                          // take proper action
-      }
+// Power task: follow USB suspend/resume, remote wakeup on key press or encoder step
+void POWER_task(void) {
+  if(HID_isSuspended() != suspended) {            // suspend state changed?
+    suspended = !suspended;
+    if(suspended) {                               // bus suspended?
+      NEO_clearAll();                             // NeoPixels off
+      VDD_suspend();                              // stop ADC
     }
-    else if(key6last) {                           // key still being pressed?
-      KEY6_HOLD();                                // take proper action
+    else {                                        // bus resumed?
+      VDD_resume();                               // restart ADC
+      NEO_encoder_update();                       // restore NeoPixel ring
     }
+  }
+  if(suspended && (keystate || encphase)) HID_wakeup(); // input -> wake up host
+}
 
-    // Handle rotary encoder
-    // ---------------------
-    if(!PIN_read(PIN_ENC_A)) {                    // encoder turned ?
-      if(PIN_read(PIN_ENC_B)) {                   // clockwise ?
-        ENC_CW_ACTION();                          // take proper action
-        NEO_encoder_cw();                         // rotate NeoPixels
-        DLY_ms(5);                                // debounce
-        ENC_CW_RELEASED();                        // take proper action
-      }
-      else {                                      // counter-clockwise ?
-        ENC_CCW_ACTION();                         // take proper action
-        NEO_encoder_ccw();                        // rotate NeoPixels
-        DLY_ms(5);                                // debounce
-        ENC_CCW_RELEASED();                       // take proper action
-      }
-      while(!PIN_read(PIN_ENC_A));                // wait until next detent
-    } 
-    else {
-      if(!isSwitchPressed && !PIN_read(PIN_ENC_SW)) {     // switch previously pressed?
-        ENC_SW_PRESSED();                         // take proper action
-        isSwitchPressed = 1;
-      }
-      else if(isSwitchPressed && PIN_read(PIN_ENC_SW)) {  // switch previously released?
-        ENC_SW_RELEASED();                        // take proper action
-        isSwitchPressed = 0;                      // update switch state
-      }
-    }
+// Telemetry task: check stack, sample supply voltage, publish performance counters
+void TELEMETRY_task(void) {
+  if(!STACK_check()) RST_now();                   // stack overflow: restart cleanly
+  VDD_update();                                   // derate NeoPixels on low VDD
+  PERF_update();                                  // counter snapshot for host
+}
 
-    DLY_ms(1);                                    // debounce
+// Task table in order of priority (function, period in ms, budget in us)
+TASK_t tasks[] = {
+  TASK(SCAN_task,        1,   20 + KEYS_SCAN_US), // scan keys
+  TASK(DISPATCH_task,    1,  500),                // handle key and encoder events
+  TASK(MACRO_task,       1,  500),                // hold actions, software timers
+  TASK(RENDER_task,      1,  200),                // NeoPixel frames
+  TASK(POWER_task,       2,10200),                // USB suspend, remote wakeup
+  TASK(TELEMETRY_task,  10,  250)                 // supply voltage, counters
+};
+
+// ===================================================================================
+// Main Function
+// ===================================================================================
+int main(void) {
+  // Setup pins for keys and encoder
+  KEYS_init();                                    // key pins from KEY_PINS
+  PIN_input_PU(PIN_ENC_SW);
+  ENC1_init();                                    // encoder A/B on timer1 (PC4/PC7)
+  ENC1_set(0, 0xffff);                            // full range for detent steps
+
+  // Start time base
+  TIME_init();                                    // start 1ms SysTick interrupt
+  #if INPUT_CAPTURE
+  CAP_init();                                     // timestamp key edges
+  #endif
+
+  // Setup NeoPixels
+  NEO_init();                                     // init NeoPixels
+  NEO_clearAll();                                 // clear NeoPixels
+
+  // Init USB HID device
+  PERF_update();                                  // first counter snapshot
+  HID_init();                                     // init USB HID device
+  VDD_init();                                     // init supply voltage monitor
+
+  // Setup EXTI events to wake up on input (after HID_init, which claims line 2 for
+  // USB D-; key 5 (PD2), encoder A (PC4) and switch (PC3) share lines and are polled)
+  #if KEY_MATRIX
+  #define KEY_EVTENTRY(n, pin) PIN_EVT_set(pin, PIN_EVT_FALLING);
+  KEY_COLS(KEY_EVTENTRY)                          // rows are held low when idle
+  #else
+  PIN_EVT_set(PIN_KEY1,  PIN_EVT_FALLING);
+  PIN_EVT_set(PIN_KEY2,  PIN_EVT_FALLING);
+  PIN_EVT_set(PIN_KEY3,  PIN_EVT_FALLING);
+  PIN_EVT_set(PIN_KEY4,  PIN_EVT_FALLING);
+  PIN_EVT_set(PIN_KEY6,  PIN_EVT_FALLING);
+  #endif
+  PIN_EVT_set(PIN_ENC_B, PIN_EVT_BOTH);
+  NEO_encoder_update();                           // set NeoPixel ring for encoder
+
+  // Loop
+  while(1) {
+    if(!TASK_schedule(tasks, TASK_count(tasks))   // run due tasks, sleep if idle
+       && INPUT_active()) INPUT_wake();           // woken up by input?
   }
 }
@@ -1,5 +1,5 @@
 // ===================================================================================
-// Basic NeoPixel Functions using Hardware-SPI for CH32V003                   * v1.0 *
+// Basic NeoPixel Functions using Hardware-SPI and DMA for CH32V003           * v1.1 *
 // ===================================================================================
 // 2023 by Stefan Wagner:   https://github.com/wagiminator
 
@@ -20,15 +20,143 @@
 #error Unsupported system frequency for NeoPixels!
 #endif
 
-uint8_t NEO_buffer[3 * NEO_COUNT];          // pixel buffer
+#define NEO_LATCH_TICKS (NEO_LATCH_TIME * DLY_US_TIME)  // latch time in system ticks
+#define NEO_DMA_WORDS   (NEO_DMA_CHUNK * 2)             // 32-bit words per half buffer
+#define NEO_BYTES       (3 * NEO_COUNT)                 // pixel bytes per frame
+#define NEO_WIRE_TICKS  ((uint32_t)NEO_BYTES * (F_CPU / 93750)) // frame time on wire
+#define NEO_SYNC_TIMEOUT (2 * DLY_MS_TIME)              // max wait for USB idle window
+
+#if NEO_USB_SYNC > 0
+#include "usb_composite.h"
+uint8_t  NEO_waiting;                       // frame deferred for USB idle window
+uint32_t NEO_waitStart;                     // SysTick count when deferral started
+#endif
+
+#if NEO_COMPACT > 0
+#if NEO_DITHER > 0
+#error NEO_COMPACT and NEO_DITHER cannot be used together!
+#endif
+typedef uint8_t  neo_val_t;                 // 8-bit intensity
+#define NEO_VAL_SHIFT   0                   // bits below the 8-bit intensity
+uint8_t   NEO_buffer[(NEO_BYTES + 1) / 2];  // pixel buffer (4 bits per channel)
+#elif NEO_DITHER > 0
+typedef uint16_t neo_val_t;                 // 8.8 fixed point intensity
+#define NEO_VAL_SHIFT   8
+neo_val_t NEO_buffer[NEO_BYTES];            // pixel buffer
+uint8_t   NEO_error[NEO_BYTES];             // dithering error accumulators
+#else
+typedef uint8_t  neo_val_t;                 // 8-bit intensity
+#define NEO_VAL_SHIFT   0
+neo_val_t NEO_buffer[NEO_BYTES];            // pixel buffer
+#endif
+
+uint32_t  NEO_dma[2 * NEO_DMA_WORDS];       // DMA double buffer (one SPI byte per bit)
+
+volatile uint8_t  NEO_state;                // 0: idle, 1: sending, 2: latching
+volatile uint32_t NEO_frameTicks;           // CPU ticks spent encoding the last frame
+volatile uint8_t  NEO_dirty;                // pixel buffer changed since last frame
+volatile uint8_t  NEO_fraction;             // last frame contained dithered channels
+volatile uint8_t  NEO_tail;                 // half buffer holding the end of the frame
+volatile uint16_t NEO_pos;                  // next pixel byte to encode
+volatile uint32_t NEO_ticks;                // encode ticks of the current frame
+volatile uint32_t NEO_frameStart;           // SysTick count at start of last frame
+volatile uint32_t NEO_frameEnd;             // SysTick count at end of last frame
+volatile uint16_t NEO_overruns;             // frames aborted due to late refill
+volatile uint16_t NEO_frames;               // frames started
+volatile uint16_t NEO_merged;               // updates merged into a pending frame
+
+#if NEO_GOVERNOR > 0
+// Pixel current per channel at full intensity in buffer order
+#if defined (NEO_GRB)
+#define NEO_mA_0        NEO_mA_G
+#define NEO_mA_1        NEO_mA_R
+#else
+#define NEO_mA_0        NEO_mA_R
+#define NEO_mA_1        NEO_mA_G
+#endif
+#define NEO_mA_2        NEO_mA_B
+#define NEO_IDLE_mA     ((NEO_COUNT * NEO_IDLE_uA + 999) / 1000)
+
+volatile uint16_t NEO_budget  = NEO_MAX_mA; // current budget for the whole string
+volatile uint16_t NEO_current = NEO_IDLE_mA;// estimated current of the last frame
+volatile uint8_t  NEO_limit   = 255;        // global brightness scale applied
+volatile uint8_t  NEO_target  = 255;        // brightness scale the governor aims for
+#endif
+
+// ===================================================================================
+// Lookup Tables (generated at compile time, stored in flash)
+// ===================================================================================
+#define NEO_T4(f,n)     f(n), f((n)+1), f((n)+2), f((n)+3)
+#define NEO_T16(f,n)    NEO_T4(f,n),   NEO_T4(f,(n)+4),   NEO_T4(f,(n)+8),    NEO_T4(f,(n)+12)
+#define NEO_T64(f,n)    NEO_T16(f,n),  NEO_T16(f,(n)+16), NEO_T16(f,(n)+32),  NEO_T16(f,(n)+48)
+#define NEO_T256(f,n)   NEO_T64(f,n),  NEO_T64(f,(n)+64), NEO_T64(f,(n)+128), NEO_T64(f,(n)+192)
+#define NEO_T512(f,n)   NEO_T256(f,n), NEO_T256(f,(n)+256)
+
+// Quarter squares n*n/4 -> a*b = sq4[a+b] - sq4[|a-b|] (multiplication without MUL)
+#define NEO_SQ4(n)      (uint16_t)(((n) * (n)) >> 2)
+static const uint16_t NEO_sq4[512] = { NEO_T512(NEO_SQ4, 0) };
+
+// Gamma correction, approximates gamma 2.2 with t^2 * (0.6 + 0.4 * t)
+#if NEO_DITHER > 0
+#define NEO_GAMMA(n)    (uint16_t)(((n) * (n) * (3 * 255 + 2 * (n)) + 635) / 1270)
+static const uint16_t NEO_gamma[256] = { NEO_T256(NEO_GAMMA, 0) };
+#else
+#define NEO_GAMMA(n)    (uint8_t)(((n) * (n) * (3 * 255 + 2 * (n)) + 162563) / 325125)
+static const uint8_t NEO_gamma[256] = { NEO_T256(NEO_GAMMA, 0) };
+#endif
+
+// SPI bytes for one nibble of pixel data, MSB first ("1": 0x7c, "0": 0x60)
+#define NEO_BIT(n,b)    ((uint32_t)((((n) >> (b)) & 1) ? 0x7c : 0x60))
+#define NEO_NIB(n)      (NEO_BIT(n,3) | NEO_BIT(n,2) << 8 | NEO_BIT(n,1) << 16 | NEO_BIT(n,0) << 24)
+static const uint32_t NEO_nib[16] = { NEO_T16(NEO_NIB, 0) };
+
+// Multiply a by b
+static inline uint16_t NEO_mul(uint8_t a, uint8_t b) {
+  uint8_t diff = (a > b) ? (a - b) : (b - a);
+  return NEO_sq4[a + b] - NEO_sq4[diff];
+}
+
+// Scale a by b/255 (exact for b = 0 and b = 255)
+static inline uint8_t NEO_scale(uint8_t a, uint8_t b) {
+  return (uint16_t)(NEO_mul(a, b) + a + b) >> 8;
+}
+
+// ===================================================================================
+// Pixel Buffer Access
+// ===================================================================================
+
+// Read intensity of pixel byte i from buffer
+static inline neo_val_t NEO_getVal(uint16_t i) {
+  #if NEO_COMPACT > 0
+  uint8_t nib = NEO_buffer[i >> 1];
+  if(i & 1) nib >>= 4;
+  nib &= 0x0f;
+  return (nib << 4) | nib;                  // expand 0..15 to 0..255
+  #else
+  return NEO_buffer[i];
+  #endif
+}
+
+// Write intensity of pixel byte i to buffer
+static inline void NEO_setVal(uint16_t i, neo_val_t val) {
+  #if NEO_COMPACT > 0
+  uint8_t *ptr = NEO_buffer + (i >> 1);
+  val = (val - (val >> 4) + 8) >> 4;        // round 0..255 to 0..15
+  if(i & 1) *ptr = (*ptr & 0x0f) | (val << 4);
+  else      *ptr = (*ptr & 0xf0) | val;
+  #else
+  NEO_buffer[i] = val;
+  #endif
+}
 
 // ===================================================================================
-// Init SPI for Neopixels
+// Init SPI and DMA for Neopixels
 // ===================================================================================
 void NEO_init(void) {
-  // Enable GPIO and SPI module clock
+  // Enable GPIO, SPI and DMA module clock
   RCC->APB2PCENR |= RCC_AFIOEN | RCC_IOPCEN | RCC_SPI1EN;
-  
+  RCC->AHBPCENR  |= RCC_DMA1EN;
+
   // Setup GPIO pin PC6 (MOSI)
   GPIOC->CFGLR = (GPIOC->CFGLR & ~((uint32_t)0b1111<<(6<<2))) | ((uint32_t)0b1001<<(6<<2));
 
@@ -40,10 +168,25 @@ void NEO_init(void) {
               | SPI_CTLR1_SSM               // software control of NSS
               | SPI_CTLR1_SSI               // set internal NSS high
               | SPI_CTLR1_SPE;              // enable SPI
+  SPI1->CTLR2 = SPI_CTLR2_TXDMAEN;          // enable TX DMA request
+
+  // Setup DMA channel 3 (SPI1_TX), circular double buffer, 8-bit
+  DMA1_Channel3->PADDR = (uint32_t)&SPI1->DATAR;
+  DMA1_Channel3->MADDR = (uint32_t)NEO_dma;
+  DMA1_Channel3->CFGR  = DMA_CFGR1_DIR      // memory to peripheral
+                       | DMA_CFGR1_MINC     // increment memory address
+                       | DMA_CFGR1_CIRC     // circular mode
+                       | DMA_CFGR1_HTIE     // half transfer interrupt
+                       | DMA_CFGR1_TCIE     // transfer complete interrupt
+                       | DMA_CFGR1_PL;      // very high priority
+
+  // Enable DMA interrupt with low priority (USB interrupt must be able to preempt)
+  NVIC_SetPriority(DMA1_Channel3_IRQn, 0x80);
+  NVIC_EnableIRQ(DMA1_Channel3_IRQn);
 }
 
 // ===================================================================================
-// Send one Data Byte to Neopixels
+// Send one Data Byte to Neopixels (blocking, only when no frame is in progress)
 // ===================================================================================
 void NEO_sendByte(uint8_t data) {
   uint8_t i;
@@ -54,47 +197,228 @@ void NEO_sendByte(uint8_t data) {
   }
 }
 
+// ===================================================================================
+// Current Governor (estimates LED current and limits global brightness)
+// ===================================================================================
+#if NEO_GOVERNOR > 0
+
+// Estimate current of the unscaled pixel buffer in mA (without idle current)
+static uint16_t NEO_estimate(void) {
+  uint32_t sum0 = 0, sum1 = 0, sum2 = 0;
+  uint16_t i;
+  for(i=0; i<NEO_BYTES; ) {
+    sum0 += NEO_getVal(i++) >> NEO_VAL_SHIFT;
+    sum1 += NEO_getVal(i++) >> NEO_VAL_SHIFT;
+    sum2 += NEO_getVal(i++) >> NEO_VAL_SHIFT;
+  }
+  return ((uint32_t)sum0 * NEO_mA_0 + (uint32_t)sum1 * NEO_mA_1
+        + (uint32_t)sum2 * NEO_mA_2 + 254) / 255;
+}
+
+// Update brightness scale for the next frame: cut immediately, release smoothly
+static void NEO_govern(void) {
+  uint16_t demand = NEO_estimate();
+  uint16_t budget = NEO_budget;
+  uint8_t  target = 255;
+  uint8_t  limit  = NEO_limit;
+  budget = (budget > NEO_IDLE_mA) ? (budget - NEO_IDLE_mA) : 0;
+  if(demand > budget) target = ((uint32_t)budget * 255) / demand;
+  if(target <= limit) limit = target;
+  else if((uint8_t)(target - limit) > NEO_GOV_STEP) limit += NEO_GOV_STEP;
+  else limit = target;
+  NEO_target  = target;
+  NEO_limit   = limit;
+  NEO_current = NEO_IDLE_mA + (((uint32_t)demand * limit + 254) / 255);
+}
+
+// Scale intensity by current brightness limit
+static inline neo_val_t NEO_limitVal(neo_val_t val) {
+  #if NEO_DITHER > 0
+  uint16_t prod = NEO_mul(val >> 8, NEO_limit) + (NEO_mul(val, NEO_limit) >> 8);
+  return prod + (prod >> 8);                // val * limit / 255
+  #else
+  return NEO_scale(val, NEO_limit);
+  #endif
+}
+
+#endif
+
+// ===================================================================================
+// Frame Encoder (fills DMA half buffers on the fly)
+// ===================================================================================
+
+// Get pixel byte to be sent (applies current limit and temporal dithering)
+static inline uint8_t NEO_getByte(uint16_t i) {
+  neo_val_t val = NEO_getVal(i);
+  #if NEO_GOVERNOR > 0
+  if(NEO_limit != 255) val = NEO_limitVal(val);
+  #endif
+  #if NEO_DITHER > 0
+  uint32_t sum = (uint32_t)val + NEO_error[i];
+  NEO_error[i]  = sum;                      // keep fraction for next frame
+  NEO_fraction |= val;                      // remember if there was a fraction
+  sum >>= 8;
+  return (sum > 255) ? 255 : sum;
+  #else
+  return val;
+  #endif
+}
+
+// Encode next chunk of pixel bytes into DMA half buffer
+RAMFUNC static void NEO_fill(uint8_t half) {
+  uint32_t *ptr = NEO_dma + (half ? NEO_DMA_WORDS : 0);
+  uint8_t  i, data;
+  for(i=NEO_DMA_CHUNK; i; i--) {
+    if(NEO_pos < NEO_BYTES) {
+      data   = NEO_getByte(NEO_pos++);
+      *ptr++ = NEO_nib[data >> 4];
+      *ptr++ = NEO_nib[data & 0x0f];
+      if(NEO_pos == NEO_BYTES) NEO_tail = half;
+    }
+    else {
+      *ptr++ = 0;                           // line stays low (start of latch)
+      *ptr++ = 0;
+    }
+  }
+}
+
+// Encode first two chunks and start DMA transfer
+static void NEO_start(void) {
+  uint32_t start = STK->CNT;
+  NEO_state      = 1;
+  NEO_dirty      = 0;
+  #if NEO_USB_SYNC > 0
+  NEO_waiting    = 0;
+  #endif
+  NEO_fraction   = 0;
+  NEO_pos        = 0;
+  NEO_tail       = 2;
+  NEO_frameStart = start;
+  NEO_frames++;
+  #if NEO_GOVERNOR > 0
+  NEO_govern();
+  #endif
+  NEO_fill(0);
+  NEO_fill(1);
+  NEO_ticks = STK->CNT - start;
+  DMA1_Channel3->CNTR  = sizeof(NEO_dma);
+  DMA1->INTFCR         = DMA_CGIF3;
+  DMA1_Channel3->CFGR |= DMA_CFGR1_EN;
+}
+
+// DMA interrupt: half buffer was sent -> refill it or finish frame
+void DMA1_Channel3_IRQHandler(void) __attribute__((interrupt)) RAMFUNC;
+void DMA1_Channel3_IRQHandler(void) {
+  uint32_t start = STK->CNT;
+  uint32_t flags = DMA1->INTFR;
+  uint8_t  half  = (flags & DMA_TCIF3) ? 1 : 0;
+  DMA1->INTFCR = DMA_CGIF3;
+  if(half != NEO_tail) {
+    NEO_fill(half);
+    flags |= DMA1->INTFR;                   // DMA reached the refilled half?
+  }
+  if((flags & (DMA_HTIF3 | DMA_TCIF3)) == (DMA_HTIF3 | DMA_TCIF3)) {
+    DMA1_Channel3->CFGR &= ~DMA_CFGR1_EN;   // preempted too long: abort frame
+    NEO_frameEnd = start;
+    NEO_overruns++;
+    NEO_dirty    = 1;                       // retry after latch
+    NEO_state    = 2;
+    return;
+  }
+  if(half == NEO_tail) {                    // last pixel byte handed to SPI?
+    DMA1_Channel3->CFGR &= ~DMA_CFGR1_EN;   // stop DMA, line is low now
+    NEO_frameEnd   = start;
+    NEO_frameTicks = NEO_ticks + (STK->CNT - start);
+    NEO_state      = 2;                     // latching
+    return;
+  }
+  NEO_ticks += STK->CNT - start;
+}
+
 // ===================================================================================
 // Write Buffer to Pixels
 // ===================================================================================
+
+// Check if frame can be started now without being preempted by USB
+static inline uint8_t NEO_ready(uint32_t now) {
+  #if NEO_USB_SYNC > 0
+  if(HID_isIdle(NEO_WIRE_TICKS)) return 1;  // in idle window of USB polling?
+  if(!NEO_waiting) {
+    NEO_waiting   = 1;
+    NEO_waitStart = now;
+    return 0;
+  }
+  return (now - NEO_waitStart) >= NEO_SYNC_TIMEOUT; // don't wait forever
+  #else
+  return 1;
+  #endif
+}
+
+// Send pending frames as soon as the transmitter is ready
+void NEO_refresh(void) {
+  uint32_t now = STK->CNT;
+  if(NEO_state == 1) return;                // frame in progress
+  if(NEO_state == 2) {                      // latching?
+    if((now - NEO_frameEnd) < NEO_LATCH_TICKS) return;
+    NEO_state = 0;
+  }
+  if(!NEO_dirty && ((now - NEO_frameStart) >= NEO_frameTicks * NEO_REPEAT_LOAD)) {
+    #if NEO_DITHER > 0
+    if(NEO_fraction) NEO_dirty = 1;         // next dithering frame
+    #endif
+    #if NEO_GOVERNOR > 0
+    if(NEO_limit != NEO_target) NEO_dirty = 1; // next brightness release step
+    #endif
+  }
+  if(NEO_dirty && NEO_ready(now)) NEO_start();
+}
+
+// Mark buffer as changed and send it if possible
 void NEO_update(void) {
-  uint8_t i;
-  uint8_t *ptr;
-  ptr = NEO_buffer;
-  for(i=3*NEO_COUNT; i; i--) NEO_sendByte(*ptr++);
-  NEO_latch();
+  if(NEO_dirty) NEO_merged++;               // previous update not sent yet
+  NEO_dirty = 1;
+  NEO_refresh();
 }
 
 // ===================================================================================
 // Clear all Pixels
 // ===================================================================================
 void NEO_clearAll(void) {
-  uint8_t i;
-  uint8_t *ptr;
-  ptr = NEO_buffer;
-  for(i=3*NEO_COUNT; i; i--) *ptr++ = 0;
+  uint16_t i;
+  uint8_t  *ptr;
+  ptr = (uint8_t*)NEO_buffer;
+  for(i=sizeof(NEO_buffer); i; i--) *ptr++ = 0;
   NEO_update();
 }
 
 // ===================================================================================
 // Write Color to a Single Pixel in Buffer
 // ===================================================================================
-void NEO_writeColor(uint8_t pixel, uint8_t r, uint8_t g, uint8_t b) {
-  uint8_t *ptr;
-  ptr = NEO_buffer + (3 * pixel);
+
+// Write raw intensities (8-bit or 8.8 fixed point) to pixel buffer
+static void NEO_writeRaw(uint16_t pixel, neo_val_t r, neo_val_t g, neo_val_t b) {
+  uint16_t i = pixel + (pixel << 1);        // 3 * pixel
   #if defined (NEO_GRB)
-    *ptr++ = g; *ptr++ = r; *ptr = b;
+    NEO_setVal(i, g); NEO_setVal(i + 1, r); NEO_setVal(i + 2, b);
   #elif defined (NEO_RGB)
-    *ptr++ = r; *ptr++ = g; *ptr = b;
+    NEO_setVal(i, r); NEO_setVal(i + 1, g); NEO_setVal(i + 2, b);
   #else
     #error Wrong or missing NeoPixel type definition!
   #endif
 }
 
+void NEO_writeColor(uint16_t pixel, uint8_t r, uint8_t g, uint8_t b) {
+  #if NEO_DITHER > 0
+  NEO_writeRaw(pixel, (neo_val_t)r << 8, (neo_val_t)g << 8, (neo_val_t)b << 8);
+  #else
+  NEO_writeRaw(pixel, r, g, b);
+  #endif
+}
+
 // ===================================================================================
 // Write Hue Value (0..191) and Brightness (0..2) to a Single Pixel in Buffer
 // ===================================================================================
-void NEO_writeHue(uint8_t pixel, uint8_t hue, uint8_t bright) {
+void NEO_writeHue(uint16_t pixel, uint8_t hue, uint8_t bright) {
   uint8_t phase = hue >> 6;
   uint8_t step  = (hue & 63) << bright;
   uint8_t nstep = (63 << bright) - step;
@@ -106,9 +430,30 @@ void NEO_writeHue(uint8_t pixel, uint8_t hue, uint8_t bright) {
   }
 }
 
+// ===================================================================================
+// Write Hue, Saturation and Value (0..255 each) to a Single Pixel in Buffer
+// ===================================================================================
+void NEO_writeHSV(uint16_t pixel, uint8_t hue, uint8_t sat, uint8_t val) {
+  uint16_t  hue3  = hue + ((uint16_t)hue << 1); // hue * 3 -> phase and step
+  uint8_t   step  = hue3;
+  uint8_t   nstep = ~step;
+  uint8_t   c, i;
+  neo_val_t rgb[3];
+  switch(hue3 >> 8) {
+    case 0:   rgb[0] = nstep; rgb[1] =  step; rgb[2] =     0; break;
+    case 1:   rgb[0] =     0; rgb[1] = nstep; rgb[2] =  step; break;
+    default:  rgb[0] =  step; rgb[1] =     0; rgb[2] = nstep; break;
+  }
+  for(i=0; i<3; i++) {
+    c      = ~NEO_scale(sat, ~(uint8_t)rgb[i]); // saturation (blend with white)
+    rgb[i] = NEO_gamma[NEO_scale(c, val)];      // value and gamma correction
+  }
+  NEO_writeRaw(pixel, rgb[0], rgb[1], rgb[2]);
+}
+
 // ===================================================================================
 // Clear Single Pixel in Buffer
 // ===================================================================================
-void NEO_clearPixel(uint8_t pixel) {
+void NEO_clearPixel(uint16_t pixel) {
   NEO_writeColor(pixel, 0, 0, 0);
 }
@@ -1,15 +1,19 @@
 // ===================================================================================
-// Basic NeoPixel Functions using Hardware-SPI for CH32V003                   * v1.0 *
+// Basic NeoPixel Functions using Hardware-SPI and DMA for CH32V003           * v1.1 *
 // ===================================================================================
 //
 // Functions available:
 // --------------------
-// NEO_init()               init hardware-SPI for NeoPixels on pin PC6
+// NEO_init()               init hardware-SPI and DMA for NeoPixels on pin PC6
 // NEO_clearAll()           clear all pixels and update
 // NEO_clearPixel(p)        clear pixel p
 // NEO_writeColor(p,r,g,b)  write RGB color to pixel p
 // NEO_writeHue(p,h,b)      write hue (h=0..191) and brightness (b=0..2) to pixel p
+// NEO_writeHSV(p,h,s,v)    write hue, saturation and value (0..255 each) to pixel p
 // NEO_update()             update pixels string (write buffer to pixels)
+// NEO_refresh()            send pending/dithering frames (call frequently)
+// NEO_busy()               check if a frame is currently being transmitted
+// NEO_setBudget(mA)        set current budget for all pixels (with NEO_GOVERNOR)
 //
 // NEO_sendByte(d)          send one data byte via hardware-SPI to pixels string
 // NEO_latch()              latch the data sent
@@ -20,6 +24,30 @@
 // - Works with most 800kHz addressable LEDs (NeoPixels).
 // - Set number of pixels and pixel type in the parameters below!
 // - System clock frequency must be 48MHz, 24MHz, or 12MHz.
+// - NEO_writeHSV() is gamma corrected and uses lookup tables in flash instead of
+//   multiplications (the RV32EC core has no hardware multiplier).
+// - NEO_update() does not block. Frames are encoded on the fly into a small double
+//   buffer which is streamed to SPI via DMA channel 3. The DMA interrupt has a lower
+//   priority than the USB interrupt, so make sure NEO_DMA_CHUNK covers the longest
+//   USB transaction. NEO_refresh() must be called regularly (e.g. in the main loop).
+// - With NEO_DITHER enabled, the buffer holds 16 bits per channel (8.8 fixed point)
+//   and the fraction is spread over successive frames by temporal dithering. Frames
+//   are repeated as long as fractions are present, limited to NEO_REPEAT_LOAD.
+// - If the DMA interrupt is delayed by more than one half buffer (e.g. by a long USB
+//   transaction), stale data would be sent. Such frames are aborted, counted in
+//   NEO_overruns and sent again. With NEO_USB_SYNC enabled, frames are started in
+//   the predicted idle window between the host's IN transactions to avoid this.
+// - With NEO_COMPACT enabled, the buffer holds 4 bits per channel (1.5 bytes per
+//   pixel), which are expanded to 8 bits while encoding. This allows long strings
+//   to fit into SRAM. It cannot be combined with NEO_DITHER.
+// - With NEO_GOVERNOR enabled, the current of each frame is estimated from the pixel
+//   buffer using the per-channel values below. If it exceeds NEO_MAX_mA (config.h),
+//   the brightness of all pixels is scaled down immediately and released smoothly
+//   by NEO_GOV_STEP per frame. NEO_current holds the estimated current in mA.
+//   The channel currents are datasheet worst case: the constant-current drivers
+//   of WS2812 parts (WS2812-2020 on the board) sink 12..20mA per channel, so
+//   20mA is assumed. The estimate errs on the safe side; parts measured to draw
+//   less can use lower values to gain brightness within the same budget.
 //
 // 2023 by Stefan Wagner:   https://github.com/wagiminator
 
@@ -29,6 +57,7 @@
 extern "C" {
 #endif
 
+#include <config.h>
 #include "system.h"
 
 // ===================================================================================
@@ -37,18 +66,56 @@ extern "C" {
 #define NEO_GRB               // type of pixels: NEO_GRB or NEO_RGB
 #define NEO_COUNT       18    // total number of pixels in the string
 #define NEO_LATCH_TIME  281   // latch time in microseconds
+#define NEO_DMA_CHUNK   12    // pixel bytes encoded per DMA half buffer (10us each)
+#define NEO_DITHER      1     // 1: enable temporal dithering (16-bit intensities)
+#define NEO_COMPACT     0     // 1: store 4 bits per channel (for long strings)
+#define NEO_USB_SYNC    1     // 1: start frames in idle window of USB host polling
+#define NEO_REPEAT_LOAD 20    // min. repeated frame period as multiple of encode time
+
+// ===================================================================================
+// NeoPixel Current Governor
+// ===================================================================================
+#define NEO_GOVERNOR    1     // 1: limit total pixel current to NEO_MAX_mA
+#define NEO_mA_R        20    // current of red channel at full intensity in mA
+#define NEO_mA_G        20    // current of green channel at full intensity in mA
+#define NEO_mA_B        20    // current of blue channel at full intensity in mA
+#define NEO_IDLE_uA     300   // quiescent current per pixel in uA
+#define NEO_GOV_STEP    2     // brightness release step per frame (0..255 scale)
+
+#ifndef NEO_MAX_mA
+#define NEO_MAX_mA      (USB_MAX_POWER_mA - 15) // current budget for all pixels
+#endif
 
 // ===================================================================================
 // NeoPixel Functions and Macros
 // ===================================================================================
 #define NEO_latch()     DLY_us(NEO_LATCH_TIME)
+#define NEO_busy()      (NEO_state != 0)
+#define NEO_setBudget(mA) {NEO_budget = (mA); NEO_dirty = 1;}
 void NEO_init(void);
 void NEO_sendByte(uint8_t data);
 void NEO_update(void);
+void NEO_refresh(void);
 void NEO_clearAll(void);
-void NEO_writeColor(uint8_t pixel, uint8_t r, uint8_t g, uint8_t b);
-void NEO_writeHue(uint8_t pixel, uint8_t hue, uint8_t bright);
-void NEO_clearPixel(uint8_t pixel);
+void NEO_writeColor(uint16_t pixel, uint8_t r, uint8_t g, uint8_t b);
+void NEO_writeHue(uint16_t pixel, uint8_t hue, uint8_t bright);
+void NEO_writeHSV(uint16_t pixel, uint8_t hue, uint8_t sat, uint8_t val);
+void NEO_clearPixel(uint16_t pixel);
+
+// Transmitter state and measured encoding load
+extern volatile uint8_t  NEO_state;       // 0: idle, 1: sending, 2: latching
+extern volatile uint32_t NEO_frameTicks;  // CPU ticks spent encoding the last frame
+extern volatile uint8_t  NEO_dirty;       // pixel buffer changed since last frame
+extern volatile uint16_t NEO_overruns;    // frames aborted due to late refill
+extern volatile uint16_t NEO_frames;      // frames started
+extern volatile uint16_t NEO_merged;      // updates merged into a pending frame
+
+// Current governor state and telemetry
+#if NEO_GOVERNOR > 0
+extern volatile uint16_t NEO_budget;      // current budget for the whole string in mA
+extern volatile uint16_t NEO_current;     // estimated current of the last frame in mA
+extern volatile uint8_t  NEO_limit;       // global brightness scale (255: unscaled)
+#endif
 
 #ifdef __cplusplus
 };
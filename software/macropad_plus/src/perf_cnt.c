@@ -0,0 +1,169 @@
+// ===================================================================================
+// Runtime Performance Counters as HID Feature Report for CH32V003            * v1.0 *
+// ===================================================================================
+// 2024 by Stefan Wagner:   https://github.com/wagiminator
+
+#include "perf_cnt.h"
+
+_Static_assert(sizeof(PERF_report_t)  == HID_COUNTER_LEN, "counter report size mismatch");
+_Static_assert(__builtin_offsetof(PERF_report_t, scanMax) == 42, "counter report layout mismatch");
+_Static_assert(sizeof(PERF_latency_t) == HID_LATENCY_LEN, "latency report size mismatch");
+_Static_assert(sizeof(PERF_keystat_t) == HID_KEYSTAT_LEN, "key statistics report size mismatch");
+#if RV003USB_PROFILE
+_Static_assert(sizeof(usb_profile_t)  == HID_PROFILE_LEN, "profile report size mismatch");
+uint32_t PERF_lastBusy;                   // USB interrupt ticks at start of last second
+#endif
+
+volatile uint32_t PERF_events;            // input events scanned
+volatile uint16_t PERF_bounces;           // debounce rejections
+
+PERF_report_t  PERF_report[2];            // double buffers for the host
+PERF_latency_t PERF_latency[2];
+PERF_keystat_t PERF_keystat[2];
+uint8_t  PERF_current;                    // buffer currently read by the host
+uint16_t PERF_loopRate;                   // main loop iterations per second
+uint32_t PERF_lastLoops;                  // loop counter at start of last second
+uint32_t PERF_lastMs;                     // start of last second
+
+uint16_t PERF_hist[PERF_LAT_BUCKETS];     // latency histogram
+uint32_t PERF_latCount;                   // number of latency measurements
+uint32_t PERF_latSum;                     // sum of latencies in us
+uint16_t PERF_latMin = 0xffff;            // minimum latency in us
+uint16_t PERF_latMax;                     // maximum latency in us
+uint16_t PERF_latLost;                    // measurements lost (ring overflow)
+uint8_t  PERF_latTail;                    // next ring buffer entry read
+
+// Clear latency histogram
+void PERF_resetLatency(void) {
+  uint8_t i;
+  for(i=0; i<PERF_LAT_BUCKETS; i++) PERF_hist[i] = 0;
+  PERF_latCount = 0;
+  PERF_latSum   = 0;
+  PERF_latMin   = 0xffff;
+  PERF_latMax   = 0;
+}
+
+// Collect latency measurements from the interrupt's ring buffer
+static void PERF_collect(void) {
+  uint8_t  head = HID_latHead;
+  uint32_t us;
+  uint8_t  b;
+  if((uint8_t)(head - PERF_latTail) > HID_LAT_RING) {   // overwritten meanwhile?
+    PERF_latLost += (uint8_t)(head - PERF_latTail) - HID_LAT_RING;
+    PERF_latTail  = head - HID_LAT_RING;
+  }
+  while(PERF_latTail != head) {
+    us = HID_latRing[PERF_latTail++ & (HID_LAT_RING - 1)] / DLY_US_TIME;
+    if(us > 0xffff) us = 0xffff;
+    b  = (us / PERF_LAT_WIDTH < PERF_LAT_BUCKETS) ? us / PERF_LAT_WIDTH : PERF_LAT_BUCKETS - 1;
+    if(PERF_hist[b] < 0xffff) PERF_hist[b]++;
+    PERF_latCount++;
+    PERF_latSum += us;
+    if(us < PERF_latMin) PERF_latMin = us;
+    if(us > PERF_latMax) PERF_latMax = us;
+  }
+}
+
+// Get latency percentile p (in %) as upper edge of its bucket in us
+static uint16_t PERF_percentile(uint8_t p) {
+  uint32_t need = (PERF_latCount * p + 99) / 100;
+  uint32_t sum  = 0;
+  uint8_t  i;
+  for(i=0; i<PERF_LAT_BUCKETS - 1; i++) {
+    sum += PERF_hist[i];
+    if(sum >= need) break;
+  }
+  return (uint16_t)(i + 1) * PERF_LAT_WIDTH;
+}
+
+// Update statistics and publish new report snapshots
+void PERF_update(void) {
+  PERF_report_t  *r = &PERF_report[PERF_current ^ 1];
+  PERF_latency_t *l = &PERF_latency[PERF_current ^ 1];
+  PERF_keystat_t *k = &PERF_keystat[PERF_current ^ 1];
+  uint32_t now = TIME_ms();
+  uint8_t  i;
+
+  // Determine main loop iterations per second
+  if((now - PERF_lastMs) >= 1000) {
+    PERF_loopRate  = TASK_loops - PERF_lastLoops;
+    PERF_lastLoops = TASK_loops;
+    PERF_lastMs    = now;
+    #if RV003USB_PROFILE
+    usb_profile.share = (usb_profile.busy - PERF_lastBusy) / (F_CPU / 1000);
+    PERF_lastBusy     = usb_profile.busy;
+    #endif
+  }
+
+  // Fill free counter buffer and hand it over
+  r->id            = HID_COUNTER_ID;
+  r->version       = 6;
+  r->loopRate      = PERF_loopRate;
+  r->events        = PERF_events;
+  r->bounces       = PERF_bounces;
+  r->overflows     = KBD_overflows + PERF_latLost;
+  r->sent[0]       = HID_sent[0];
+  r->sent[1]       = HID_sent[1];
+  r->sent[2]       = HID_sent[2];
+  r->repeats       = HID_repeats;
+  r->framesSent    = NEO_frames;
+  r->framesSkipped = NEO_merged + NEO_overruns;
+  r->usb.sync      = rv003usb_internal_data.errors.sync;
+  r->usb.stuff     = rv003usb_internal_data.errors.stuff;
+  r->usb.crc       = rv003usb_internal_data.errors.crc;
+  r->usb.pid       = rv003usb_internal_data.errors.pid;
+  r->usb.retrans   = rv003usb_internal_data.errors.retrans;
+  r->scanMax       = KEYS_scanMax / DLY_US_TIME;
+  r->stackFree     = STACK_free();
+  r->stackSize     = STACK_size();
+  #if NEO_GOVERNOR > 0
+  r->neoCurrent    = NEO_current;
+  r->neoBudget     = NEO_budget;
+  r->neoLimit      = NEO_limit;
+  #else
+  r->neoCurrent    = 0;
+  r->neoBudget     = 0;
+  r->neoLimit      = 255;
+  #endif
+  r->vddMv         = VDD_mV;
+  r->vddDips       = VDD_dips;
+  r->reserved[0]   = 0;
+  r->reserved[1]   = 0;
+  r->reserved[2]   = 0;
+  HID_setFeature(HID_COUNTER_ID, r, sizeof(PERF_report_t));
+
+  // Fill free latency buffer and hand it over
+  PERF_collect();
+  l->id      = HID_LATENCY_ID;
+  l->buckets = PERF_LAT_BUCKETS;
+  l->width   = PERF_LAT_WIDTH;
+  l->count   = PERF_latCount;
+  l->min     = PERF_latCount ? PERF_latMin : 0;
+  l->avg     = PERF_latCount ? PERF_latSum / PERF_latCount : 0;
+  l->max     = PERF_latMax;
+  l->p50     = PERF_latCount ? PERF_percentile(50) : 0;
+  l->p90     = PERF_latCount ? PERF_percentile(90) : 0;
+  l->p99     = PERF_latCount ? PERF_percentile(99) : 0;
+  for(i=0; i<PERF_LAT_BUCKETS; i++) l->hist[i] = PERF_hist[i];
+  HID_setFeature(HID_LATENCY_ID, l, sizeof(PERF_latency_t));
+
+  // Fill free key statistics buffer and hand it over
+  k->id   = HID_KEYSTAT_ID;
+  k->keys = KEYS_COUNT;
+  for(i=0; i<KEYS_COUNT; i++) {
+    k->key[i].presses = DEB_stats[i].presses;
+    k->key[i].bounces = DEB_stats[i].bounces;
+    k->key[i].minGap  = DEB_stats[i].minGap;
+    k->key[i].chatter = DEB_stats[i].chatter;
+    k->key[i].window  = DEB_window(i);
+    k->key[i].extra   = DEB_extra[i];
+  }
+  HID_setFeature(HID_KEYSTAT_ID, k, sizeof(PERF_keystat_t));
+
+  // USB interrupt profile is read directly (may mix values of two updates)
+  #if RV003USB_PROFILE
+  HID_setFeature(HID_PROFILE_ID, &usb_profile, sizeof(usb_profile_t));
+  #endif
+
+  PERF_current ^= 1;
+}
@@ -0,0 +1,191 @@
+// ===================================================================================
+// Runtime Performance Counters as HID Feature Report for CH32V003            * v1.0 *
+// ===================================================================================
+//
+// This library collects the runtime statistics of the firmware modules in a
+// counter block and a histogram of the input latency, which the host can read as
+// HID feature reports (e.g. on Linux via hidraw and ioctl HIDIOCGFEATURE) without
+// attaching a debugger.
+//
+// Functions available:
+// --------------------
+// PERF_update()            update statistics and publish new report snapshots
+// PERF_event(n)            count n scanned input events
+// PERF_bounce(n)           count n debounce rejections
+// PERF_resetLatency()      clear latency histogram
+//
+// Counter report (ID HID_COUNTER_ID, all values little-endian, counters wrap):
+// -----------------------------------------------------------------------------
+// Byte   Type    Content
+//  0     uint8   report ID (4)
+//  1     uint8   layout version (6)
+//  2     uint16  main loop iterations per second
+//  4     uint32  input events scanned (key edges, encoder steps)
+//  8     uint16  debounce rejections
+// 10     uint16  queue overflows (keys dropped, keyboard report full)
+// 12     uint32  reports sent with ID 1 (keyboard)
+// 16     uint32  reports sent with ID 2 (consumer)
+// 20     uint32  reports sent with ID 3 (mouse)
+// 24     uint32  reports sent unchanged (would be NAKed by a NAKing device)
+// 28     uint16  NeoPixel frames sent
+// 30     uint16  NeoPixel frames skipped (merged updates and aborted frames)
+// 32     uint16  USB packets dropped: SE0 during SYNC or PID (missed SYNC)
+// 34     uint16  USB packets dropped: bit-stuff violation or framing error
+// 36     uint16  USB packets dropped: bad CRC
+// 38     uint16  USB packets dropped: unexpected PID or endpoint
+// 40     uint16  USB DATA packets retransmitted by host (data toggle mismatch)
+// 42     uint16  longest key scan in us since reset (KEYS_scanMax)
+// 44     uint16  stack bytes never used since reset (0: stack overflowed)
+// 46     uint16  stack size in bytes (SRAM above static variables)
+// 48     uint16  estimated NeoPixel current of the last frame in mA (0: no governor)
+// 50     uint16  NeoPixel current budget in mA (0: no governor)
+// 52     uint16  supply voltage in mV (VDD_mV, averaged ADC measurement)
+// 54     uint16  supply dips below the PVD level (VDD_dips, brightness cuts)
+// 56     uint8   NeoPixel brightness scale applied by the governor (255: unscaled)
+// 57     3 bytes reserved (0)
+//
+// Latency report (ID HID_LATENCY_ID, all values little-endian, times in us):
+// ---------------------------------------------------------------------------
+// Byte   Type    Content
+//  0     uint8   report ID (5)
+//  1     uint8   number of histogram buckets (PERF_LAT_BUCKETS)
+//  2     uint16  bucket width (PERF_LAT_WIDTH)
+//  4     uint32  number of measurements
+//  8     uint16  minimum
+// 10     uint16  average
+// 12     uint16  maximum
+// 14     uint16  50th percentile (upper bucket edge)
+// 16     uint16  90th percentile (upper bucket edge)
+// 18     uint16  99th percentile (upper bucket edge)
+// 20     uint16  bucket counts (last bucket includes all longer latencies)
+//
+// Key statistics report (ID HID_KEYSTAT_ID, all values little-endian):
+// ----------------------------------------------------------------------
+// Byte   Type    Content
+//  0     uint8   report ID (6)
+//  1     uint8   number of keys (KEYS_COUNT)
+//  2     8 bytes per key, key 1 first (see PERF_key_t):
+//   +0   uint16  debounced presses
+//   +2   uint16  edges rejected within the debounce window (bounces)
+//   +4   uint8   shortest interval between two raw edges in ms (0: none yet)
+//   +5   uint8   chatter events (edges shortly after the window, saturates)
+//   +6   uint8   effective debounce window (ms, or scans with DEB_INTEGRATE)
+//   +7   uint8   window extension caused by chatter
+//
+// Profile report (ID HID_PROFILE_ID, only with RV003USB_PROFILE): see usb_profile_t
+// in usb_handler.h. Times are in system ticks, share is in per mille of CPU time.
+//
+// Notes:
+// ------
+// - PERF_update() must be called regularly (e.g. every 10ms). The loop rate is
+//   determined once per second, the snapshots for the host on every call.
+// - Input latency is measured from the scan that detected a key edge (marked with
+//   HID_markEdge()) to the IN token that is answered with the resulting report.
+//   The time between the physical edge and its detection (up to one scan period)
+//   is not included, except for keys timestamped by timer2 input capture (see
+//   key_cap.h), which start at the physical edge. Measurements are taken in the
+//   USB interrupt and collected from a small ring buffer by PERF_update(). If
+//   more than HID_LAT_RING values arrive in between, the oldest are lost
+//   (counted in the counter report's queue overflows).
+// - The USB error counters tell a marginal signal (SYNC, bit-stuff and CRC errors)
+//   from a slow or overloaded host (retransmissions after ACKs that were sent
+//   too late or got lost). See struct usb_errors in usb_handler.h.
+// - A key with rising chatter or shrinking minimum edge interval indicates a worn
+//   switch. Its debounce window is already lengthened automatically.
+// - The HID device does not NAK IN tokens, it always answers with the current
+//   report. Unchanged reports are counted instead.
+//
+// 2024 by Stefan Wagner:   https://github.com/wagiminator
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "system.h"
+#include "time_stk.h"
+#include "scheduler.h"
+#include "neo_spi.h"
+#include "vdd_mon.h"
+#include "usb_composite.h"
+#include "key_scan.h"
+#include "key_deb.h"
+
+#if RV003USB_HID_FEATURES == 0
+  #error Performance counters require HID feature reports (RV003USB_HID_FEATURES)!
+#endif
+#if SYS_STACK_PAINT == 0
+  #error Performance counters require stack painting (SYS_STACK_PAINT)!
+#endif
+
+// Latency Histogram Parameters
+#define PERF_LAT_BUCKETS  32                    // number of buckets
+#define PERF_LAT_WIDTH    250                   // bucket width in us
+
+// Counter Block (feature report layout)
+typedef struct {
+  uint8_t  id;                          // report ID
+  uint8_t  version;                     // layout version
+  uint16_t loopRate;                    // main loop iterations per second
+  uint32_t events;                      // input events scanned
+  uint16_t bounces;                     // debounce rejections
+  uint16_t overflows;                   // queue overflows
+  uint32_t sent[3];                     // reports sent per ID
+  uint32_t repeats;                     // reports sent unchanged
+  uint16_t framesSent;                  // NeoPixel frames sent
+  uint16_t framesSkipped;               // NeoPixel frames skipped
+  struct {                              // USB receive errors and retransmissions
+    uint16_t sync, stuff, crc, pid, retrans;
+  } usb;
+  uint16_t scanMax;                     // longest key scan in us
+  uint16_t stackFree;                   // stack bytes never used
+  uint16_t stackSize;                   // stack size in bytes
+  uint16_t neoCurrent;                  // estimated NeoPixel current in mA
+  uint16_t neoBudget;                   // NeoPixel current budget in mA
+  uint16_t vddMv;                       // supply voltage in mV
+  uint16_t vddDips;                     // supply dips below PVD level
+  uint8_t  neoLimit;                    // NeoPixel brightness scale
+  uint8_t  reserved[3];                 // reserved (0), pads to 32-bit size
+} PERF_report_t;
+
+// Latency Histogram (feature report layout)
+typedef struct {
+  uint8_t  id;                          // report ID
+  uint8_t  buckets;                     // number of buckets
+  uint16_t width;                       // bucket width in us
+  uint32_t count;                       // number of measurements
+  uint16_t min, avg, max;               // latency summary in us
+  uint16_t p50, p90, p99;               // percentiles in us
+  uint16_t hist[PERF_LAT_BUCKETS];      // bucket counts
+} PERF_latency_t;
+
+// Key Statistics (feature report layout)
+typedef struct {
+  uint16_t presses;                     // debounced presses
+  uint16_t bounces;                     // edges rejected within the window
+  uint8_t  minGap;                      // shortest interval between raw edges in ms
+  uint8_t  chatter;                     // edges shortly after the window
+  uint8_t  window;                      // effective debounce window
+  uint8_t  extra;                       // window extension by chatter
+} PERF_key_t;
+
+typedef struct {
+  uint8_t  id;                          // report ID
+  uint8_t  keys;                        // number of keys
+  PERF_key_t key[KEYS_COUNT];           // switch statistics per key
+} PERF_keystat_t;
+
+// Counters of the application
+extern volatile uint32_t PERF_events;   // input events scanned
+extern volatile uint16_t PERF_bounces;  // debounce rejections
+
+// Functions
+#define PERF_event(n)     PERF_events += (n)
+#define PERF_bounce(n)    PERF_bounces += (n)
+void PERF_update(void);
+void PERF_resetLatency(void);
+
+#ifdef __cplusplus
+};
+#endif
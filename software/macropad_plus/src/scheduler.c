@@ -0,0 +1,48 @@
+// ===================================================================================
+// Rate-Monotonic Cooperative Task Scheduler for CH32V003                     * v1.0 *
+// ===================================================================================
+// 2024 by Stefan Wagner:   https://github.com/wagiminator
+
+#include "scheduler.h"
+
+volatile uint32_t TASK_busyTicks;         // ticks spent in tasks
+volatile uint32_t TASK_idleTicks;         // ticks spent sleeping
+volatile uint32_t TASK_loops;             // main loop iterations
+
+// Run the most urgent due task or sleep until next interrupt/event
+uint8_t TASK_schedule(TASK_t *tasks, uint8_t count) {
+  uint32_t now = TIME_ms();
+  uint32_t start, ticks;
+  int32_t  late;
+
+  TASK_loops++;
+
+  // Find due task with highest priority and run it
+  for(; count; count--, tasks++) {
+    late = now - tasks->next;
+    if(late < 0) continue;                // not due yet
+    if(late >= tasks->period) {           // missed a whole period?
+      if(tasks->next) tasks->misses++;    // (not counted on first release)
+      tasks->next = now + tasks->period;  // resynchronize
+    }
+    else tasks->next += tasks->period;    // keep strict period
+    start = STK->CNT;
+    tasks->function();
+    ticks = STK->CNT - start;
+    TASK_busyTicks += ticks;
+    if(ticks > tasks->maxTicks) tasks->maxTicks = ticks;
+    if(ticks > tasks->budget)   tasks->overruns++;
+    return 1;
+  }
+
+  // No task due: sleep until next interrupt/event
+  start = STK->CNT;
+  #if TASK_SLEEP_WFE > 0
+  PFIC->SCTLR |= PFIC_SEVONPEND;          // interrupts wake from WFE too
+  SLEEP_WFE_now();
+  #else
+  SLEEP_WFI_now();
+  #endif
+  TASK_idleTicks += STK->CNT - start;
+  return 0;
+}
@@ -0,0 +1,70 @@
+// ===================================================================================
+// Rate-Monotonic Cooperative Task Scheduler for CH32V003                     * v1.0 *
+// ===================================================================================
+//
+// Functions available:
+// --------------------
+// TASK(f,p,b)              task table entry: function f, period p ms, budget b us
+// TASK_schedule(t,n)       run the most urgent due task of table t with n entries,
+//                          or sleep if no task is due (returns 0 after sleeping)
+// TASK_release(t)          release task t now (e.g. after wake-up by an event)
+// TASK_setPeriod(t,p)      change period of task t to p ms
+// TASK_count(t)            number of entries of task table t
+//
+// Notes:
+// ------
+// - Tasks are prioritized by their position in the table. Following the rate-
+//   monotonic principle, tasks with shorter periods should come first.
+// - After each task, scheduling starts again from the top of the table, so a
+//   due input task never waits for more than one lower priority task.
+// - Execution time of every run is measured in system ticks. Runs exceeding the
+//   budget are counted as overruns, releases missed by a full period as misses.
+// - If no task is due, the MCU sleeps until the next interrupt, at the latest
+//   until the next 1ms SysTick interrupt of the time base. TIME_init() must be
+//   called first. With TASK_SLEEP_WFE enabled, WFE is used instead of WFI with
+//   SEVONPEND set, so EXTI events (e.g. from key pins, set up with PIN_EVT_set())
+//   wake the MCU as well as all interrupts. This way pins can wake the MCU even
+//   if their EXTI interrupt is not available (EXTI7_0 is used by USB).
+// - Idle and busy ticks are accumulated to determine the CPU load, calls of
+//   TASK_schedule() are counted as main loop iterations.
+//
+// 2024 by Stefan Wagner:   https://github.com/wagiminator
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "system.h"
+#include "time_stk.h"
+
+// Scheduler Parameters
+#define TASK_SLEEP_WFE    1                   // 1: sleep with WFE (wake on events)
+
+// Task Control Block
+typedef struct {
+  void   (*function)(void);           // task function
+  uint16_t period;                    // release period in ms
+  uint32_t budget;                    // execution time budget in system ticks
+  uint32_t next;                      // next release time in ms
+  uint32_t maxTicks;                  // worst execution time measured
+  uint16_t overruns;                  // number of runs exceeding the budget
+  uint16_t misses;                    // number of missed releases
+} TASK_t;
+
+// Scheduler Functions and Macros
+#define TASK(f,p,b)       { f, p, (uint32_t)(b) * DLY_US_TIME, 0, 0, 0, 0 }
+#define TASK_count(t)     (sizeof(t) / sizeof(TASK_t))
+#define TASK_release(t)   (t)->next = TIME_ms()
+#define TASK_setPeriod(t,p) (t)->period = (p)
+uint8_t TASK_schedule(TASK_t *tasks, uint8_t count);
+
+// CPU Load Statistics (in system ticks, wrap around)
+extern volatile uint32_t TASK_busyTicks;  // ticks spent in tasks
+extern volatile uint32_t TASK_idleTicks;  // ticks spent sleeping
+extern volatile uint32_t TASK_loops;      // main loop iterations
+
+#ifdef __cplusplus
+};
+#endif
@@ -228,6 +228,10 @@ extern uint32_t _ebss;
 extern uint32_t _data_lma;
 extern uint32_t _data_vma;
 extern uint32_t _edata;
+extern uint32_t _ramfunc_lma;
+extern uint32_t _ramfunc_vma;
+extern uint32_t _eramfunc;
+extern uint32_t _eusrstack;
 
 // Prototypes
 int main(void)                __attribute__((section(".text.main"), used));
@@ -324,6 +328,7 @@ void reset_handler(void) {
   uint32_t *src, *dst;
   
   // Set pointers, vectors, processor status, and interrupts
+  // (INTSYSCR = 0x3: hardware prologue/epilogue and interrupt nesting enabled)
   asm volatile(
   " .option push              \n\
     .option norelax           \n\
@@ -344,6 +349,11 @@ void reset_handler(void) {
     : : [main] "r" (main) : "a0", "a1" , "memory"
   );
 
+  // Copy functions marked with RAMFUNC from FLASH to RAM
+  src = &_ramfunc_lma;
+  dst = &_ramfunc_vma;
+  while(dst < &_eramfunc) *dst++ = *src++;
+
   // Copy data from FLASH to RAM
   src = &_data_lma;
   dst = &_data_vma;
@@ -355,6 +365,14 @@ void reset_handler(void) {
   while(dst < &_ebss) *dst++ = 0;
   #endif
 
+  // Paint stack up to the current stack pointer, canary at the bottom
+  #if SYS_STACK_PAINT > 0
+  asm volatile("mv %0, sp" : "=r" (src));
+  dst = &_ebss;
+  *dst++ = STACK_CANARY;
+  while(dst < src) *dst++ = STACK_PAINT;
+  #endif
+
   // C++ Support
   #ifdef __cplusplus
   __libc_init_array();
@@ -366,3 +384,28 @@ void reset_handler(void) {
   // Return
   asm volatile("mret");
 }
+
+// ===================================================================================
+// Stack (STACK) Functions
+// ===================================================================================
+#if SYS_STACK_PAINT > 0
+
+// Get stack size in bytes (SRAM above static variables)
+uint16_t STACK_size(void) {
+  return (uint32_t)&_eusrstack - (uint32_t)&_ebss;
+}
+
+// Get bytes of stack never used since reset (0 if canary is gone)
+uint16_t STACK_free(void) {
+  uint32_t *ptr = &_ebss;
+  if(*ptr++ != STACK_CANARY) return 0;
+  while((ptr < &_eusrstack) && (*ptr == STACK_PAINT)) ptr++;
+  return (uint32_t)ptr - (uint32_t)&_ebss - 4;
+}
+
+// Check canary at bottom of stack (0: stack overflowed into static variables)
+uint8_t STACK_check(void) {
+  return (_ebss == STACK_CANARY);
+}
+
+#endif
@@ -107,6 +107,14 @@
 // INT_disable()            global interrupt disable
 // INT_ATOMIC_BLOCK { }     execute block without being interrupted
 //
+// RAMFUNC                  attribute: place function in SRAM (copied on startup)
+//
+// Stack (STACK) functions available (SYS_STACK_PAINT = 1):
+// ---------------------------------------------------------
+// STACK_size()             get stack size in bytes (SRAM above static variables)
+// STACK_free()             get bytes of stack never used since reset (high-water mark)
+// STACK_check()            check canary at bottom of stack (0: stack overflowed)
+//
 // References:
 // -----------
 // - CNLohr ch32v003fun: https://github.com/cnlohr/ch32v003fun
@@ -131,6 +139,7 @@ extern "C" {
 #define SYS_CLEAR_BSS     1         // 1: clear uninitialized variables
 #define SYS_USE_VECTORS   1         // 1: create interrupt vector table
 #define SYS_USE_HSE       0         // 1: use external crystal
+#define SYS_STACK_PAINT   1         // 1: paint stack on startup for STACK functions
 
 // ===================================================================================
 // Sytem Clock Defines
@@ -341,6 +350,9 @@ void STDBY_WFE_now(void);   // put device into standby (deep sleep), wake up eve
 #define INT_ATOMIC_BLOCK      for(INT_ATOMIC_RESTORE, __ToDo = 1; __ToDo; __ToDo = 0)
 #define INT_ATOMIC_RESTORE    uint32_t __reg_save __attribute__((__cleanup__(__iRestore))) = __iSave()
 
+// Execute function from SRAM (no flash wait states, costs SRAM for its code)
+#define RAMFUNC               __attribute__((section(".ramfunc"), noinline))
+
 // Save interrupt status and disable interrupts
 static inline uint32_t __iSave(void) {
   uint32_t result, temp;
@@ -369,6 +381,19 @@ static inline void __iRestore(const uint32_t *__s) {
   );
 }
 
+// ===================================================================================
+// Stack (STACK) Functions
+// ===================================================================================
+// The stack grows down from the end of SRAM towards the static variables (.bss).
+// On startup, the free SRAM is filled with STACK_PAINT and the lowest word gets
+// STACK_CANARY. Words still holding the paint have never been used.
+#define STACK_PAINT           0xA5A5A5A5
+#define STACK_CANARY          0x5CA1AB1E
+
+uint16_t STACK_size(void);          // get stack size in bytes
+uint16_t STACK_free(void);          // get bytes never used (0 if canary is gone)
+uint8_t  STACK_check(void);         // check canary (0: stack overflowed)
+
 // ===================================================================================
 // Device Electronic Signature (ESIG)
 // ===================================================================================
@@ -467,7 +492,8 @@ __attribute__( ( always_inline ) ) static inline void __WFE(void) {
   asm volatile ("wfi");
 }
 
-// Set VTF Interrupt
+// Set VTF Interrupt (vector-table-free, num 0 or 1; the USB handler uses slot
+// RV003USB_VTF_SLOT, the other slot is free for a fast timer interrupt)
 static inline void SetVTFIRQ(uint32_t addr, IRQn_Type IRQn, uint8_t num, FunctionalState NewState) {
   if(num > 1)  return;
   if(NewState != DISABLE) {
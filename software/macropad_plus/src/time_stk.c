@@ -0,0 +1,146 @@
+// ===================================================================================
+// Monotonic Time Base and Software Timers using SysTick for CH32V003         * v1.0 *
+// ===================================================================================
+// 2024 by Stefan Wagner:   https://github.com/wagiminator
+
+#include "time_stk.h"
+
+volatile uint32_t TIME_msLow;             // milliseconds since start (low word)
+volatile uint32_t TIME_msHigh;            // milliseconds since start (high word)
+volatile uint32_t TIME_msTick;            // SysTick count of last millisecond
+
+TMR_timer_t *TMR_wheel[TMR_SLOTS];        // timer wheel slots
+uint32_t     TMR_last;                    // last millisecond processed
+
+// ===================================================================================
+// Time Base
+// ===================================================================================
+
+// Start 1ms SysTick compare interrupt (SysTick keeps running freely)
+void TIME_init(void) {
+  TIME_msTick = STK->CNT;
+  TMR_last    = TIME_msLow;
+  STK->CMP    = TIME_msTick + DLY_MS_TIME;
+  STK->SR     = 0;
+  STK->CTLR  |= STK_CTLR_STIE;
+  NVIC_SetPriority(SysTicK_IRQn, 0x80);   // low priority (USB must preempt)
+  NVIC_EnableIRQ(SysTicK_IRQn);
+}
+
+// SysTick interrupt: count milliseconds
+void SysTick_Handler(void) __attribute__((interrupt));
+void SysTick_Handler(void) {
+  uint32_t tick = TIME_msTick;
+  STK->SR = 0;
+  do {
+    tick += DLY_MS_TIME;
+    if(!(++TIME_msLow)) TIME_msHigh++;
+    TIME_msTick = tick;
+    STK->CMP    = tick + DLY_MS_TIME;
+  } while((int32_t)(STK->CNT - (tick + DLY_MS_TIME)) >= 0); // catch up if late
+}
+
+// Get consistent snapshot of millisecond counter and its SysTick count
+static inline uint32_t TIME_snapshot(uint32_t *high, uint32_t *tick, uint32_t *cnt) {
+  uint32_t low;
+  do {
+    low   = TIME_msLow;
+    *high = TIME_msHigh;
+    *tick = TIME_msTick;
+    *cnt  = STK->CNT;
+  } while(low != TIME_msLow);             // millisecond passed meanwhile?
+  return low;
+}
+
+// Get milliseconds since start (32-bit)
+uint32_t TIME_ms(void) {
+  return TIME_msLow;
+}
+
+// Get milliseconds since start (64-bit)
+uint64_t TIME_ms64(void) {
+  uint32_t high, low;
+  do {
+    high = TIME_msHigh;
+    low  = TIME_msLow;
+  } while(high != TIME_msHigh);
+  return ((uint64_t)high << 32) | low;
+}
+
+// Get microseconds since start (32-bit)
+uint32_t TIME_us(void) {
+  uint32_t high, tick, cnt;
+  uint32_t low = TIME_snapshot(&high, &tick, &cnt);
+  return low * 1000 + (cnt - tick) / DLY_US_TIME;
+}
+
+// Get microseconds since start (64-bit)
+uint64_t TIME_us64(void) {
+  uint32_t high, tick, cnt;
+  uint32_t low = TIME_snapshot(&high, &tick, &cnt);
+  return ((((uint64_t)high << 32) | low) * 1000) + (cnt - tick) / DLY_US_TIME;
+}
+
+// Get system ticks since start (64-bit)
+uint64_t TIME_ticks64(void) {
+  uint32_t high, tick, cnt;
+  uint32_t low = TIME_snapshot(&high, &tick, &cnt);
+  return ((((uint64_t)high << 32) | low) * DLY_MS_TIME) + (cnt - tick);
+}
+
+// ===================================================================================
+// Software Timers
+// ===================================================================================
+
+// Insert timer into wheel slot of its expiry time
+static void TMR_insert(TMR_timer_t *t) {
+  TMR_timer_t **slot = &TMR_wheel[t->expire & (TMR_SLOTS - 1)];
+  t->next   = *slot;
+  *slot     = t;
+  t->active = 1;
+}
+
+// Start timer, expires in ms (at least 1), then every period ms (0: one-shot)
+void TMR_start(TMR_timer_t *t, uint32_t ms, uint32_t period, void (*callback)(void)) {
+  if(t->active) TMR_stop(t);
+  if(!ms) ms = 1;
+  t->expire   = TIME_ms() + ms;
+  t->period   = period;
+  t->callback = callback;
+  TMR_insert(t);
+}
+
+// Stop timer
+void TMR_stop(TMR_timer_t *t) {
+  TMR_timer_t **ptr = &TMR_wheel[t->expire & (TMR_SLOTS - 1)];
+  while(*ptr) {
+    if(*ptr == t) {
+      *ptr = t->next;
+      break;
+    }
+    ptr = &(*ptr)->next;
+  }
+  t->active = 0;
+}
+
+// Advance timer wheel up to current millisecond and run expired callbacks
+void TMR_process(void) {
+  uint32_t    now = TIME_ms();
+  TMR_timer_t *t;
+  while(TMR_last != now) {
+    TMR_last++;
+    t = TMR_wheel[TMR_last & (TMR_SLOTS - 1)];
+    while(t) {
+      if(t->expire == TMR_last) {
+        TMR_stop(t);                      // unlink before callback may restart it
+        if(t->period) {
+          t->expire += t->period;
+          TMR_insert(t);
+        }
+        t->callback();
+        t = TMR_wheel[TMR_last & (TMR_SLOTS - 1)]; // list may have changed
+      }
+      else t = t->next;
+    }
+  }
+}
@@ -0,0 +1,75 @@
+// ===================================================================================
+// Monotonic Time Base and Software Timers using SysTick for CH32V003         * v1.0 *
+// ===================================================================================
+//
+// Time functions available:
+// -------------------------
+// TIME_init()              start 1ms SysTick compare interrupt
+// TIME_ticks()             get system ticks (32-bit, wraps after 89s @ 48MHz)
+// TIME_ticks64()           get system ticks (64-bit)
+// TIME_ms()                get milliseconds since start (32-bit)
+// TIME_ms64()              get milliseconds since start (64-bit)
+// TIME_us()                get microseconds since start (32-bit)
+// TIME_us64()              get microseconds since start (64-bit)
+//
+// Software timer functions available:
+// -----------------------------------
+// TMR_start(t,ms,p,cb)     start timer t, expires in ms, then every p ms (p=0: once)
+// TMR_stop(t)              stop timer t
+// TMR_isActive(t)          check if timer t is running
+// TMR_process()            advance timer wheel and run expired callbacks
+//
+// Notes:
+// ------
+// - SysTick keeps running freely at F_CPU as set up by STK_init(), so DLY_ticks()
+//   and the USB clock calibration are not affected. The compare interrupt fires
+//   every millisecond and only increments the millisecond counter.
+// - None of the time functions disables interrupts. Consistent values are
+//   obtained by re-reading the millisecond counter if it changed meanwhile.
+// - Timers are kept in a hashed timer wheel with TMR_SLOTS slots of 1ms each,
+//   starting and stopping a timer is O(1). TMR_process() must be called
+//   regularly from the main loop, callbacks run in its context (not in the
+//   interrupt), so they may use blocking functions. Missed milliseconds are
+//   caught up on the next call.
+// - Timers and callbacks must only be started/stopped from main loop context.
+//
+// 2024 by Stefan Wagner:   https://github.com/wagiminator
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "system.h"
+
+// Timer Parameters
+#define TMR_SLOTS       8               // number of timer wheel slots (power of 2)
+
+// Software Timer Type
+typedef struct TMR_timer {
+  struct TMR_timer *next;               // next timer in the same wheel slot
+  uint32_t expire;                      // expiry time in ms
+  uint32_t period;                      // reload period in ms (0: one-shot)
+  void (*callback)(void);               // function called on expiry
+  uint8_t  active;                      // timer is running
+} TMR_timer_t;
+
+// Time Functions
+#define TIME_ticks()    (STK->CNT)
+void     TIME_init(void);
+uint64_t TIME_ticks64(void);
+uint32_t TIME_ms(void);
+uint64_t TIME_ms64(void);
+uint32_t TIME_us(void);
+uint64_t TIME_us64(void);
+
+// Software Timer Functions
+#define TMR_isActive(t) ((t)->active)
+void TMR_start(TMR_timer_t *t, uint32_t ms, uint32_t period, void (*callback)(void));
+void TMR_stop(TMR_timer_t *t);
+void TMR_process(void);
+
+#ifdef __cplusplus
+};
+#endif
@@ -12,6 +12,157 @@ volatile uint8_t CON_report[]   = {2,0,0};
 volatile uint8_t MOUSE_report[] = {3,0,0,0,0};
 volatile uint8_t KBD_state;
 
+// ===================================================================================
+// Published Reports (with precomputed CRC16, double-buffered)
+// ===================================================================================
+#define HID_WIRE_MAX  (sizeof(KBD_report) + 2)  // longest report + CRC16
+
+typedef struct {
+  uint8_t  buf[2][HID_WIRE_MAX];              // report + CRC16 (LSB first)
+  uint8_t * volatile wire;                    // buffer streamed by the interrupt
+  volatile uint8_t fresh;                     // published since last sent
+  volatile uint32_t edge[2];                  // input edge of buffer (0: none)
+} HID_wire_t;
+
+HID_wire_t KBD_wire, CON_wire, MOUSE_wire;
+
+// Calculate USB data CRC16 (reflected polynomial 0xA001, init 0xFFFF, inverted)
+static uint16_t HID_crc16(const uint8_t *data, uint8_t len) {
+  uint16_t crc = 0xffff;
+  uint8_t  i;
+  while(len--) {
+    crc ^= *data++;
+    for(i=8; i; i--) crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : (crc >> 1);
+  }
+  return ~crc;
+}
+
+// Input latency measurement
+volatile uint32_t HID_edge;                   // pending edge (SysTick, 0: none)
+volatile uint32_t HID_latRing[HID_LAT_RING];  // measured latencies in ticks
+volatile uint8_t  HID_latHead;                // next ring buffer entry written
+
+// Copy report into free buffer, append CRC16 and hand it over to the interrupt
+static void HID_publish(HID_wire_t *w, const volatile uint8_t *report, uint8_t len) {
+  uint8_t  n   = (w->wire == w->buf[0]) ? 1 : 0;
+  uint8_t *buf = w->buf[n];
+  uint32_t edge;
+  uint16_t crc;
+  uint8_t  i;
+  for(i=0; i<len; i++) buf[i] = report[i];
+  crc = HID_crc16(buf, len);
+  buf[len]     = crc;
+  buf[len + 1] = crc >> 8;
+  INT_ATOMIC_BLOCK {                          // no IN token between check and handover
+    edge = HID_edge;                          // first report after edge takes it
+    if(w->fresh && w->edge[n ^ 1]) edge = w->edge[n ^ 1]; // replaced unsent: keep edge
+    w->edge[n] = edge;
+    w->wire    = buf;
+    w->fresh   = 1;
+  }
+  HID_edge = 0;
+}
+
+#define KBD_publish()   HID_publish(&KBD_wire,   KBD_report,   sizeof(KBD_report))
+#define CON_publish()   HID_publish(&CON_wire,   CON_report,   sizeof(CON_report))
+#define MOUSE_publish() HID_publish(&MOUSE_wire, MOUSE_report, sizeof(MOUSE_report))
+
+// ===================================================================================
+// Statistics and Feature Report
+// ===================================================================================
+volatile uint32_t HID_sent[3];                // IN reports sent per ID (1..3)
+volatile uint32_t HID_repeats;                // IN reports sent unchanged
+volatile uint16_t KBD_overflows;              // keys dropped (all slots in use)
+
+const uint8_t * volatile HID_feature[HID_FEATURES]; // feature reports read by host
+volatile uint8_t HID_featureLen[HID_FEATURES];
+
+// Set feature report (must stay valid until replaced)
+void HID_setFeature(uint8_t id, const void *report, uint8_t len) {
+  id -= HID_FEATURE_ID;
+  if(id >= HID_FEATURES) return;
+  HID_feature[id]    = 0;                     // no half-updated pair in interrupt
+  HID_featureLen[id] = len;
+  HID_feature[id]    = report;
+}
+
+// Put latency of sent buffer into ring buffer (called in interrupt)
+static inline void HID_stamp(HID_wire_t *w, uint32_t now) {
+  uint8_t n = (w->wire == w->buf[1]) ? 1 : 0;
+  if(!w->edge[n]) return;
+  HID_latRing[HID_latHead & (HID_LAT_RING - 1)] = now - w->edge[n];
+  HID_latHead++;
+  w->edge[n] = 0;
+}
+
+// Publish initial reports and start USB
+void HID_init(void) {
+  KBD_publish();
+  CON_publish();
+  MOUSE_publish();
+  usb_setup();
+}
+
+// ===================================================================================
+// USB Bus Timing
+// ===================================================================================
+volatile int32_t HID_inPhase  = -1;           // IN token phase (-1: not learned yet)
+volatile int32_t HID_inLength;                // duration of IN transaction
+
+// Learn IN token phase and transaction length (called at start and end of IN)
+static inline void HID_learnIn(uint32_t start, struct rv003usb_internal * ist) {
+  int32_t phase  = start - ist->last_se0_cyccount;
+  int32_t length = STK->CNT - start;
+  if((phase < 0) || (phase >= DLY_MS_TIME)) return;   // keep-alive missed
+  if(HID_inPhase < 0) HID_inPhase = phase;
+  else HID_inPhase += (phase - HID_inPhase) >> 3;     // smooth jitter
+  if(length > HID_inLength) HID_inLength = length;    // keep worst case
+}
+
+// ===================================================================================
+// USB Suspend and Remote Wakeup
+// ===================================================================================
+uint8_t  HID_suspended;                       // bus is suspended
+uint8_t  HID_wokeup;                          // remote wakeup sent in this suspend
+uint32_t HID_suspendSE0;                      // last keep-alive before suspend
+
+// Check if bus is suspended
+uint8_t HID_isSuspended(void) {
+  uint32_t se0 = rv003usb_internal_data.last_se0_cyccount;
+  if(HID_suspended) {
+    if(se0 != HID_suspendSE0) HID_suspended = 0;      // keep-alive -> resume
+  }
+  else if(rv003usb_internal_data.my_address
+       && ((STK->CNT - se0) > HID_SUSPEND_TIME)) {    // no keep-alive for 3ms
+    HID_suspended  = 1;
+    HID_wokeup     = 0;
+    HID_suspendSE0 = se0;
+  }
+  return HID_suspended;
+}
+
+// Send remote wakeup signal (once per suspend, if enabled by host)
+uint8_t HID_wakeup(void) {
+  if(!HID_suspended || HID_wokeup || !usb_remote_wakeup_enabled) return 0;
+  if((STK->CNT - HID_suspendSE0) < HID_WAKEUP_DELAY) return 0;
+  usb_send_wakeup();
+  HID_wokeup = 1;
+  return 1;
+}
+
+// Check if no IN transaction is expected within the next ticks
+uint8_t HID_isIdle(uint32_t ticks) {
+  int32_t phase = STK->CNT - rv003usb_internal_data.last_se0_cyccount;
+  int32_t start = HID_inPhase - HID_GUARD;
+  int32_t end   = HID_inPhase + HID_inLength + HID_GUARD;
+  if(HID_inPhase < 0) return 1;                       // no polling learned yet
+  if((phase < 0) || (phase >= 2 * DLY_MS_TIME)) return 1; // no keep-alive (suspend)
+  if(phase >= DLY_MS_TIME) phase -= DLY_MS_TIME;      // one keep-alive missed
+  if((int32_t)ticks + (end - start) > DLY_MS_TIME) return 1; // never fits
+  if(phase >= end) return (phase + (int32_t)ticks) <= (start + DLY_MS_TIME);
+  return (phase + (int32_t)ticks) <= start;
+}
+
 // ===================================================================================
 // ASCII to keycode mapping table
 // ===================================================================================
@@ -32,8 +183,8 @@ const uint8_t KBD_map[128] = {
 // Standard Keyboard Functions
 // ===================================================================================
 
-// Press a key on keyboard
-void KBD_press(uint8_t key) {
+// Add a key to keyboard report
+static void KBD_add(uint8_t key) {
   uint8_t i;
 
   // Convert key for HID report
@@ -63,10 +214,11 @@ void KBD_press(uint8_t key) {
       return;                                   // and return
     }
   }
+  KBD_overflows++;                              // no slot left: key dropped
 }
 
-// Release a key on keyboard
-void KBD_release(uint8_t key) {
+// Remove a key from keyboard report
+static void KBD_remove(uint8_t key) {
   uint8_t i;
 
   // Convert key for HID report
@@ -90,6 +242,18 @@ void KBD_release(uint8_t key) {
   }
 }
 
+// Press a key on keyboard
+void KBD_press(uint8_t key) {
+  KBD_add(key);
+  KBD_publish();
+}
+
+// Release a key on keyboard
+void KBD_release(uint8_t key) {
+  KBD_remove(key);
+  KBD_publish();
+}
+
 // Press and release a key on keyboard
 void KBD_type(uint8_t key) {
   KBD_press(key);
@@ -102,6 +266,7 @@ void KBD_type(uint8_t key) {
 void KBD_releaseAll(void) {
   uint8_t i;
   for(i=7; i; i--) KBD_report[i] = 0;           // delete all keys in report
+  KBD_publish();
 }
 
 // Write text with keyboard
@@ -116,11 +281,13 @@ void KBD_print(char* str) {
 // Press a consumer key on keyboard
 void CON_press(uint8_t key) {
   CON_report[1] = key;
+  CON_publish();
 }
 
 // Release a consumer key on keyboard
 void CON_release(void) {
   CON_report[1] = 0;
+  CON_publish();
 }
 
 // Press and release a consumer key on keyboard
@@ -138,11 +305,13 @@ void CON_type(uint8_t key) {
 // Press mouse button(s)
 void MOUSE_press(uint8_t buttons) {
   MOUSE_report[1] |= buttons;                   // press button(s)
+  MOUSE_publish();
 }
 
 // Release mouse button(s)
 void MOUSE_release(uint8_t buttons) {
   MOUSE_report[1] &= ~buttons;                  // release button(s)
+  MOUSE_publish();
 }
 
 // Move mouse pointer
@@ -170,19 +339,54 @@ void usb_handle_user_in_request(struct usb_endpoint * e, uint8_t * scratchpad, i
 
   // Mouse
   if(endp == 1) {
+    uint32_t start = STK->CNT;
     if(!(--dev)) dev = 3;
-    switch(dev) {
-      case 1: usb_send_data((uint8_t*)&KBD_report, sizeof(KBD_report), 0, sendtok); return;
-      case 2: usb_send_data((uint8_t*)&CON_report, sizeof(CON_report), 0, sendtok); return;
-      case 3: usb_send_data((uint8_t*)&MOUSE_report, sizeof(MOUSE_report), 0, sendtok);
-              MOUSE_report[2] = 0; MOUSE_report[3] = 0; MOUSE_report[4] = 0; return;
+    switch(dev) {                               // CRC precomputed: poly_function=2 (exclude)
+      case 1: usb_send_data(KBD_wire.wire, sizeof(KBD_report) + 2, 2, sendtok);
+              if(!KBD_wire.fresh) HID_repeats++;
+              HID_stamp(&KBD_wire, start);
+              KBD_wire.fresh = 0; break;
+      case 2: usb_send_data(CON_wire.wire, sizeof(CON_report) + 2, 2, sendtok);
+              if(!CON_wire.fresh) HID_repeats++;
+              HID_stamp(&CON_wire, start);
+              CON_wire.fresh = 0; break;
+      case 3: if(MOUSE_report[2] | MOUSE_report[3] | MOUSE_report[4]) {
+                usb_send_data((uint8_t*)&MOUSE_report, sizeof(MOUSE_report), 0, sendtok);
+                MOUSE_report[2] = 0; MOUSE_report[3] = 0; MOUSE_report[4] = 0;
+              }
+              else {
+                usb_send_data(MOUSE_wire.wire, sizeof(MOUSE_report) + 2, 2, sendtok);
+                if(!MOUSE_wire.fresh) HID_repeats++;
+                HID_stamp(&MOUSE_wire, start);
+              }
+              MOUSE_wire.fresh = 0; break;
     }
+    HID_sent[dev - 1]++;
+    HID_learnIn(start, ist);
+    return;
   }
 
   // Control transfer
   usb_send_empty(sendtok);
 }
 
+#if RV003USB_HID_FEATURES
+// Host reads feature report (GET_REPORT): low byte of wValue is the report ID
+void usb_handle_hid_get_report_start(struct usb_endpoint * e, int reqLen, uint32_t lValueLSBIndexMSB) {
+  uint8_t id = (lValueLSBIndexMSB & 0xff) - HID_FEATURE_ID;
+  const uint8_t *report;
+  if(id >= HID_FEATURES) return;                        // unknown: empty answer
+  report = HID_feature[id];
+  if(!report) return;
+  e->opaque  = (uint8_t*)report;
+  e->max_len = (reqLen < HID_featureLen[id]) ? reqLen : HID_featureLen[id];
+}
+
+// Host writes feature report (SET_REPORT): not supported, data is ignored
+void usb_handle_hid_set_report_start(struct usb_endpoint * e, int reqLen, uint32_t lValueLSBIndexMSB) {
+}
+#endif
+
 void usb_handle_user_data(struct usb_endpoint * e, int current_endpoint, uint8_t * data, int len, struct rv003usb_internal * ist) {
   if(current_endpoint == 1) KBD_state = data[0];
 }
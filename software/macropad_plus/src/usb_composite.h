@@ -5,6 +5,9 @@
 // Functions available:
 // --------------------
 // HID_init()               init HID composite device
+// HID_isIdle(t)            check if no IN transaction is expected within t ticks
+// HID_isSuspended()        check if the host suspended the bus (updates state)
+// HID_wakeup()             send remote wakeup once per suspend (if host allows)
 //
 // KBD_press(k)             press a key on keyboard (see below for control keys)
 // KBD_release(k)           release a key on keyboard
@@ -17,6 +20,9 @@
 // CON_release()            release consumer/multimedia key
 // CON_type(k)              press and release a consumer/multimedia key
 //
+// HID_setFeature(i,r,l)    set feature report ID i to r with length l (for host)
+// HID_markEdge(t)          mark input edge at SysTick t for latency measurement
+//
 // MOUSE_press(b)           press button(s) (see below)
 // MOUSE_release(b)         release button(s)
 // MOUSE_move(x,y)          move mouse pointer (relative)
@@ -24,6 +30,33 @@
 // MOUSE_wheel_up()         move mouse wheel one step up
 // MOUSE_wheel_down()       move mouse wheel one step down
 //
+// Notes:
+// ------
+// - The phase of the host's IN tokens relative to the 1ms keep-alive (SE0) and the
+//   duration of the IN transaction are learned while the device is polled. This
+//   allows time-critical tasks (e.g. NeoPixel frames) to be started in the idle
+//   window between two transactions via HID_isIdle().
+// - The bus is regarded as suspended if no keep-alive was seen for HID_SUSPEND_TIME
+//   after enumeration. It is resumed on the next keep-alive. HID_isSuspended() must
+//   be called regularly (at least every 89s) to keep track of this.
+// - Keyboard, consumer and mouse button reports are published with their data CRC16
+//   appended whenever they change. The interrupt only streams the precomputed bytes
+//   on IN tokens. Reports are double-buffered, so the interrupt never sees a half
+//   written report. Mouse movement is relative and cleared by the interrupt after
+//   sending, so a report with pending movement still gets its CRC on the fly.
+// - The host can read the reports set by HID_setFeature() with GET_REPORT (feature,
+//   IDs from HID_FEATURE_ID). The buffer must stay valid until replaced. Switching
+//   between two buffers, with more time between updates than a control transfer
+//   takes, prevents the host from reading half-updated reports.
+// - Input latency: the edge marked by HID_markEdge() is attached to the next
+//   published report. When the interrupt answers the first IN token with this
+//   report, the ticks since the edge are put into the HID_latRing buffer, which is
+//   evaluated outside the interrupt (see perf_cnt.h). HID_markEdge(0) discards an
+//   edge that did not lead to a report. If a report is replaced before it was
+//   sent (e.g. the keys of a chord or the steps of a macro), its edge moves on to
+//   the new report. So each edge yields exactly one measurement, taken when the
+//   first report carrying it is sent.
+//
 // 2023 by Stefan Wagner:   https://github.com/wagiminator
 
 #pragma once
@@ -36,7 +69,31 @@ extern "C" {
 #include "usb_handler.h"
 
 // Functions
-#define HID_init usb_setup                  // init HID composite device
+void HID_init(void);                        // init HID composite device
+uint8_t HID_isIdle(uint32_t ticks);         // check for idle window of USB bus
+uint8_t HID_isSuspended(void);              // check if bus is suspended
+uint8_t HID_wakeup(void);                   // send remote wakeup signal
+
+#define HID_SUSPEND_TIME  (3 * DLY_MS_TIME) // no keep-alive -> suspended
+#define HID_WAKEUP_DELAY  (5 * DLY_MS_TIME) // min. bus idle before remote wakeup
+void HID_setFeature(uint8_t id, const void *report, uint8_t len); // feature report
+
+// Input latency measurement (edge -> first IN with the resulting report)
+#define HID_LAT_RING      8                 // latency ring buffer size (power of 2)
+#define HID_markEdge(t)   HID_edge = (t) ? ((t) | 1) : 0 // (0: discard edge)
+extern volatile uint32_t HID_edge;          // pending edge (SysTick, 0: none)
+extern volatile uint32_t HID_latRing[HID_LAT_RING]; // measured latencies in ticks
+extern volatile uint8_t  HID_latHead;       // next ring buffer entry written
+
+// Statistics
+extern volatile uint32_t HID_sent[3];       // IN reports sent per ID (1..3)
+extern volatile uint32_t HID_repeats;       // IN reports sent unchanged
+extern volatile uint16_t KBD_overflows;     // keys dropped (all slots in use)
+
+// USB bus timing learned from host polling (in system ticks)
+#define HID_GUARD   (40 * DLY_US_TIME)      // safety margin around IN transaction
+extern volatile int32_t HID_inPhase;        // IN token phase after keep-alive
+extern volatile int32_t HID_inLength;       // duration of IN transaction
 
 void KBD_press(uint8_t key);                // press a key on keyboard
 void KBD_release(uint8_t key);              // release a key on keyboard
@@ -32,16 +32,40 @@ extern "C" {
 #define RV003USB_HANDLE_IN_REQUEST    1
 #define RV003USB_OTHER_CONTROL        0
 #define RV003USB_HANDLE_USER_DATA     1
-#define RV003USB_HID_FEATURES         0
+#define RV003USB_HID_FEATURES         1
 //#define RV003USB_SUPPORT_CONTROL_OUT  0
 //#define RV003USB_CUSTOM_C             0
 
+// Interrupt entry options
+#define RV003USB_VTF                  1   // 1: USB interrupt as VTF (no table fetch)
+#define RV003USB_VTF_SLOT             0   // VTF slot used (0 or 1)
+#define RV003USB_HPE                  1   // 1: rely on hardware prologue/epilogue
+#define RV003USB_VTF_MEASURE          0   // 1: measure entry latency on usb_setup()
+#define RV003USB_RAMFUNC              0   // 1: run handler from SRAM (see usb_handler.S)
+#define RV003USB_PROFILE              0   // 1: profile interrupt occupancy (needs HPE)
+
 #ifndef __ASSEMBLER__
 #include <usb.h>
+#include "key_scan.h"
 
 // ===================================================================================
 // HID Report Descriptor
 // ===================================================================================
+// Vendor defined feature reports (telemetry, see perf_cnt.h)
+#define HID_FEATURE_ID    4     // ID of first feature report
+#define HID_FEATURES      (3 + RV003USB_PROFILE) // number of feature reports
+#define HID_COUNTER_ID    4     // performance counters
+#define HID_COUNTER_LEN   60    // report length in bytes including ID
+#define HID_LATENCY_ID    5     // input latency histogram
+#define HID_LATENCY_LEN   84    // report length in bytes including ID
+#define HID_KEYSTAT_ID    6     // switch statistics per key
+#define HID_KEYSTAT_LEN   (2 + 8 * KEYS_COUNT) // report length in bytes including ID
+#define HID_PROFILE_ID    7     // USB interrupt profile (RV003USB_PROFILE)
+#define HID_PROFILE_LEN   140   // report length in bytes including ID
+#if HID_KEYSTAT_LEN > 255
+  #error Too many keys for the key statistics report (HID_KEYSTAT_LEN > 255)!
+#endif
+
 static const uint8_t ReportDescr[] = {
   // Standard keyboard
   0x05, 0x01,           // USAGE_PAGE (Generic Desktop)
@@ -121,6 +145,33 @@ static const uint8_t ReportDescr[] = {
   0x95, 0x03,           //     REPORT_COUNT (3)
   0x81, 0x06,           //     INPUT (Data,Var,Rel)
   0xc0,                 //   END_COLLECTION
+  0xc0,                 // END_COLLECTION
+
+  // Vendor defined feature reports
+  0x06, 0x00, 0xff,     // USAGE_PAGE (Vendor Defined Page 1)
+  0x09, 0x01,           // USAGE (Vendor Usage 1)
+  0xa1, 0x01,           // COLLECTION (Application)
+  0x15, 0x00,           //   LOGICAL_MINIMUM (0)
+  0x26, 0xff, 0x00,     //   LOGICAL_MAXIMUM (255)
+  0x75, 0x08,           //   REPORT_SIZE (8)
+  0x85, HID_COUNTER_ID, //   REPORT_ID (4)
+  0x09, 0x01,           //   USAGE (Vendor Usage 1)
+  0x95, HID_COUNTER_LEN-1, //   REPORT_COUNT (59)
+  0xb1, 0x02,           //   FEATURE (Data,Var,Abs)
+  0x85, HID_LATENCY_ID, //   REPORT_ID (5)
+  0x09, 0x02,           //   USAGE (Vendor Usage 2)
+  0x95, HID_LATENCY_LEN-1, //   REPORT_COUNT (83)
+  0xb1, 0x02,           //   FEATURE (Data,Var,Abs)
+  0x85, HID_KEYSTAT_ID, //   REPORT_ID (6)
+  0x09, 0x04,           //   USAGE (Vendor Usage 4)
+  0x95, HID_KEYSTAT_LEN-1, //   REPORT_COUNT (2 + 8 * keys - 1)
+  0xb1, 0x02,           //   FEATURE (Data,Var,Abs)
+  #if RV003USB_PROFILE
+  0x85, HID_PROFILE_ID, //   REPORT_ID (7)
+  0x09, 0x03,           //   USAGE (Vendor Usage 3)
+  0x95, HID_PROFILE_LEN-1, //   REPORT_COUNT (139)
+  0xb1, 0x02,           //   FEATURE (Data,Var,Abs)
+  #endif
   0xc0                  // END_COLLECTION
 };
 
@@ -164,7 +215,7 @@ static const struct USB_CFG_DESCR_HID CfgDescr = {
     .bNumInterfaces     = 1,                      // number of interfaces: 1
     .bConfigurationValue= 1,                      // value to select this configuration
     .iConfiguration     = 0,                      // no configuration string descriptor
-    .bmAttributes       = 0x80,                   // attributes = bus powered, no wakeup
+    .bmAttributes       = 0xa0,                   // attributes = bus powered, remote wakeup
     .MaxPower           = USB_MAX_POWER_mA / 2    // in 2mA units
   },
 
@@ -14,10 +14,74 @@
 #define ENDPOINT0_SIZE 8 //Fixed for USB 1.1, Low Speed.
 
 struct rv003usb_internal rv003usb_internal_data;
+volatile uint8_t usb_remote_wakeup_enabled;
 
 #define LOCAL_CONCAT(A, B) A##B
 #define LOCAL_EXP(A, B) LOCAL_CONCAT(A,B)
 
+#if RV003USB_VTF_MEASURE
+// Measure interrupt entry latency with the software interrupt: once through the
+// vector table, once as VTF. Both include the same C prologue, so the difference
+// is the gain of the VTF entry.
+volatile uint16_t usb_irq_entry[2];
+volatile uint32_t usb_irq_stamp;
+
+void SW_Handler(void) __attribute__((interrupt));
+void SW_Handler(void) {
+  usb_irq_stamp = STK->CNT;
+}
+
+static void usb_measure_entry(void) {
+  uint32_t start;
+  uint8_t  i;
+  NVIC_EnableIRQ(Software_IRQn);
+  for(i=0; i<2; i++) {
+    if(i) SetVTFIRQ((uint32_t)SW_Handler, Software_IRQn, RV003USB_VTF_SLOT, ENABLE);
+    usb_irq_stamp = 0;
+    start = STK->CNT;
+    NVIC_SetPendingIRQ(Software_IRQn);
+    while(!usb_irq_stamp);
+    usb_irq_entry[i] = usb_irq_stamp - start;
+  }
+  SetVTFIRQ((uint32_t)SW_Handler, Software_IRQn, RV003USB_VTF_SLOT, DISABLE);
+  NVIC_DisableIRQ(Software_IRQn);
+}
+#endif
+
+#if RV003USB_PROFILE
+// Interrupt occupancy profiler (called by the interrupt just before it returns)
+usb_profile_t usb_profile = { .id = HID_PROFILE_ID, .shift = USB_PROF_SHIFT };
+volatile uint8_t usb_prof_pid;
+
+void usb_profile_record(uint32_t entry) {
+  uint32_t ticks = STK->CNT - entry;
+  uint32_t b     = ticks >> USB_PROF_SHIFT;
+  uint8_t  c;
+  switch(usb_prof_pid) {
+    case 0b10110100: c = 1; break;            // SETUP
+    case 0b10000111: c = 2; break;            // OUT
+    case 0b10010110: c = 3; break;            // IN
+    case 0b11000011: c = 4; break;            // DATA0
+    case 0b11010010: c = 5; break;            // DATA1
+    case 0b01001011: c = 6; break;            // ACK
+    default:         c = 0; break;            // keep-alive, error or unknown
+  }
+  usb_prof_pid = 0;
+  if(ticks > 0xffff) ticks = 0xffff;
+  if(b >= USB_PROF_BUCKETS) b = USB_PROF_BUCKETS - 1;
+  if(usb_profile.hist[c][b] < 0xffff) usb_profile.hist[c][b]++;
+  if(ticks > usb_profile.worst[c]) usb_profile.worst[c] = ticks;
+  usb_profile.busy += ticks;
+}
+
+// Track worst execution time of a user callback
+static inline void usb_profile_callback(uint8_t cb, uint32_t start) {
+  uint32_t ticks = STK->CNT - start;
+  if(ticks > 0xffff) ticks = 0xffff;
+  if(ticks > usb_profile.cbMax[cb]) usb_profile.cbMax[cb] = ticks;
+}
+#endif
+
 void usb_setup(void) {
   rv003usb_internal_data.se0_windup = 0;
 
@@ -49,10 +113,37 @@ void usb_setup(void) {
   LOCAL_EXP(GPIO,USB_PORT)->BSHR = 1<<USB_PIN_DPU;
   #endif
 
+  #if RV003USB_VTF_MEASURE
+  usb_measure_entry();
+  #endif
+
+  // Fast interrupt entry: the core jumps directly to the handler, skipping the
+  // vector table fetch from flash
+  #if RV003USB_VTF
+  SetVTFIRQ((uint32_t)EXTI7_0_IRQHandler, EXTI7_0_IRQn, RV003USB_VTF_SLOT, ENABLE);
+  #endif
+
   // enable interrupt
   NVIC_EnableIRQ(EXTI7_0_IRQn);
 }
 
+// Signal remote wakeup by driving the K state (D+ high, D- low) for 10ms.
+void usb_send_wakeup(void) {
+  GPIO_TypeDef * port = LOCAL_EXP(GPIO, USB_PORT);
+  uint32_t cfg = port->CFGLR;
+  uint32_t odr = port->OUTDR;
+
+  NVIC_DisableIRQ(EXTI7_0_IRQn);
+  port->BSHR  = (1<<USB_PIN_DP) | (1<<(USB_PIN_DM+16));
+  port->CFGLR = (cfg & ~((0xf<<(USB_PIN_DP*4)) | (0xf<<(USB_PIN_DM*4))))
+              | (0b0011<<(4*USB_PIN_DP)) | (0b0011<<(4*USB_PIN_DM));
+  DLY_ms(10);
+  port->CFGLR = cfg;   // release bus, host continues resume signaling
+  port->OUTDR = odr;
+  EXTI->INTFR = 1<<USB_PIN_DM;
+  NVIC_EnableIRQ(EXTI7_0_IRQn);
+}
+
 
 void usb_pid_handle_in(uint32_t addr, uint8_t * data, uint32_t endp, uint32_t unused, struct rv003usb_internal * ist) {
   ist->current_endpoint = endp;
@@ -66,7 +157,13 @@ void usb_pid_handle_in(uint32_t addr, uint8_t * data, uint32_t endp, uint32_t un
   if(e->custom || endp) {
     // Can re-use data-stack as scratchpad.
     sendnow = __builtin_assume_aligned(data, 4);
+    #if RV003USB_PROFILE
+    uint32_t start = STK->CNT;
+    usb_handle_user_in_request(e, sendnow, endp, sendtok, ist);
+    usb_profile_callback(0, start);
+    #else
     usb_handle_user_in_request(e, sendnow, endp, sendtok, ist);
+    #endif
     return;
   }
   #endif
@@ -103,13 +200,22 @@ void usb_pid_handle_data(uint32_t this_token, uint8_t * data, uint32_t which_dat
   uint8_t * data_in = __builtin_assume_aligned( data, 4 );
 
   // Alrady received this packet.
-  if(e->toggle_out != which_data) goto just_ack;
+  if(e->toggle_out != which_data) {
+    ist->errors.retrans++;  // Host repeated DATA, our ACK got lost.
+    goto just_ack;
+  }
 
   e->toggle_out = !e->toggle_out;
 
   #if RV003USB_HANDLE_USER_DATA
   if(epno || (!ist->setup_request && length > 3)) {
+    #if RV003USB_PROFILE
+    uint32_t start = STK->CNT;
+    usb_handle_user_data( e, epno, data_in, length, ist );
+    usb_profile_callback(1, start);
+    #else
     usb_handle_user_data( e, epno, data_in, length, ist );
+    #endif
     #if RV003USB_USER_DATA_HANDLES_TOKEN
     return;
     #endif
@@ -185,6 +291,12 @@ void usb_pid_handle_data(uint32_t this_token, uint8_t * data, uint32_t which_dat
     else if(reqShl == (0x0500>>1)) {  // SET_ADDRESS = 0x05
       ist->my_address = wvi;
     }
+    else if(reqShl == (0x0300>>1)) {  // SET_FEATURE = 0x03 (device)
+      if(wvi == 1) usb_remote_wakeup_enabled = 1; // DEVICE_REMOTE_WAKEUP
+    }
+    else if(reqShl == (0x0100>>1)) {  // CLEAR_FEATURE = 0x01 (device)
+      if(wvi == 1) usb_remote_wakeup_enabled = 0; // DEVICE_REMOTE_WAKEUP
+    }
 
     //  You could handle SET_CONFIGURATION == 0x0900 here if you wanted.
     //  Can also handle GET_CONFIGURATION == 0x0880 to which we send back { 0x00 }, or the interface number.  (But no one does this).
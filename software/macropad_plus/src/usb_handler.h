@@ -74,6 +74,47 @@ void usb_send_empty( uint32_t token );
 
 void usb_setup();
 
+// USB interrupt handler (usb_handler.S)
+void EXTI7_0_IRQHandler(void);
+
+// Interrupt entry latency in cycles via vector table [0] and VTF [1], the
+// difference is the gain of the VTF entry (RV003USB_VTF_MEASURE=1).
+#if RV003USB_VTF_MEASURE
+extern volatile uint16_t usb_irq_entry[2];
+#endif
+
+// Interrupt occupancy profiler (RV003USB_PROFILE=1): durations from interrupt
+// entry (after the SE0 check) to exit in system ticks, sorted by the PID of the
+// received packet (0: keep-alive, error or unknown). The structure is the feature
+// report HID_PROFILE_ID, share is updated by the application once per second.
+#if RV003USB_PROFILE
+#if !RV003USB_HPE
+  #error USB profiler requires hardware prologue/epilogue (RV003USB_HPE)!
+#endif
+#define USB_PROF_CLASSES  7     // none, SETUP, OUT, IN, DATA0, DATA1, ACK
+#define USB_PROF_BUCKETS  8     // histogram buckets per class
+#define USB_PROF_SHIFT    10    // bucket width: 2^10 ticks (21.3us)
+
+typedef struct {
+  uint8_t  id;                                // report ID
+  uint8_t  shift;                             // bucket width = 2^shift ticks
+  uint16_t share;                             // CPU share of USB in per mille
+  uint32_t busy;                              // ticks spent in interrupt (wraps)
+  uint16_t cbMax[2];                          // worst ticks of user in/data callback
+  uint16_t worst[USB_PROF_CLASSES];           // worst ticks per class
+  uint16_t hist[USB_PROF_CLASSES][USB_PROF_BUCKETS]; // durations per class
+  uint16_t reserved;
+} usb_profile_t;
+
+extern usb_profile_t usb_profile;
+extern volatile uint8_t usb_prof_pid;
+void usb_profile_record(uint32_t entry);
+#endif
+
+// Remote wakeup: enabled by host via SET_FEATURE(DEVICE_REMOTE_WAKEUP)
+extern volatile uint8_t usb_remote_wakeup_enabled;
+void usb_send_wakeup( void ); // Drive K state for 10ms (only while suspended!)
+
 #define LogUEvent( a, b, c,  d )
 #define GetUEvent() 0
 
@@ -106,8 +147,19 @@ void usb_setup();
 #define LAST_SE0_OFFSET         4
 #define DELTA_SE0_OFFSET        8
 #define SE0_WINDUP_OFFSET       12
+#define ENDP_OFFSET             16
 #endif
 
+#ifdef  RV003USB_OPTIMIZE_FLASH
+#define ERRORS_OFFSET           (ENDP_OFFSET + ENDPOINTS * 32)
+#else
+#define ERRORS_OFFSET           (ENDP_OFFSET + ENDPOINTS * 16)
+#endif
+#define ERR_SYNC_OFFSET         (ERRORS_OFFSET + 0)
+#define ERR_STUFF_OFFSET        (ERRORS_OFFSET + 2)
+#define ERR_CRC_OFFSET          (ERRORS_OFFSET + 4)
+#define ERR_PID_OFFSET          (ERRORS_OFFSET + 6)
+
 #ifndef __ASSEMBLER__
 
 #define EMPTY_SEND_BUFFER (uint8_t*)1
@@ -139,6 +191,18 @@ _Static_assert( (sizeof(struct usb_endpoint) == 32), "usb_endpoint must be pow2
 _Static_assert( (sizeof(struct usb_endpoint) == 16), "usb_endpoint must be pow2 sized" );
 #endif
 
+// Receive errors, counted by the handler for packets it drops (counters wrap).
+// A damaged packet can be counted more than once, since the rest of it may start
+// another (failing) receive.
+struct usb_errors {
+  uint16_t sync;          // SE0 during SYNC or PID (missed SYNC, truncated packet)
+  uint16_t stuff;         // bit-stuff violation, incomplete last byte, overlong packet
+  uint16_t crc;           // bad token CRC5 or data CRC16
+  uint16_t pid;           // unknown PID or token for nonexistent endpoint
+  uint16_t retrans;       // DATA repeated by host (toggle mismatch, ACK was lost)
+  uint16_t reserved;
+};
+
 struct rv003usb_internal {
   TURBO8TYPE current_endpoint; // Can this be combined with setup_request?
   TURBO8TYPE my_address;       // Will be 0 until set up.
@@ -150,8 +214,11 @@ struct rv003usb_internal {
   // 5 bytes + 6 * ENDPOINTS
 
   struct usb_endpoint eps[ENDPOINTS];
+  struct usb_errors errors;
 };
 
+_Static_assert( (__builtin_offsetof(struct rv003usb_internal, errors) == ERRORS_OFFSET), "ERRORS_OFFSET mismatch" );
+
 //Detailed analysis of some useful stuff and performance tweaking: http://naberius.de/2015/05/14/esp8266-gpio-output-performance/
 //Reverse engineerd boot room can be helpful, too: http://cholla.mmto.org/esp8266/bootrom/boot.txt
 //USB Protocol read from wikipedia: https://en.wikipedia.org/wiki/USB
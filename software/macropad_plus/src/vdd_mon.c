@@ -0,0 +1,86 @@
+// ===================================================================================
+// Supply Voltage Monitor using ADC, DMA and PVD for CH32V003                 * v1.0 *
+// ===================================================================================
+// 2024 by Stefan Wagner:   https://github.com/wagiminator
+
+#include "vdd_mon.h"
+#include "gpio.h"
+
+#if NEO_GOVERNOR == 0
+#error VDD monitor requires the NeoPixel current governor (NEO_GOVERNOR)!
+#endif
+
+#define VDD_SPAN_mV   (VDD_FULL_mV - VDD_MIN_mV)
+
+uint16_t VDD_buffer[VDD_SAMPLES];         // Vref conversions written by DMA
+volatile uint16_t VDD_mV = VDD_FULL_mV;   // last measured supply voltage in mV
+volatile uint16_t VDD_dips;               // number of PVD brightness cuts
+
+// ===================================================================================
+// Init ADC, DMA and PVD
+// ===================================================================================
+void VDD_init(void) {
+  // Setup ADC: continuous conversion of Vref with slowest sampling
+  RCC->CFGR0      |= RCC_ADCPRE_DIV8;     // ADC clock = HCLK / 8
+  ADC_init();                             // enable and calibrate ADC
+  ADC_slow();                             // set slow mode (most accurate)
+  ADC_input_VREF();                       // set Vref as ADC input
+
+  // Setup DMA channel 1 (ADC): circular buffer, 16-bit, lowest priority
+  RCC->AHBPCENR   |= RCC_DMA1EN;
+  DMA1_Channel1->PADDR = (uint32_t)&ADC1->RDATAR;
+  DMA1_Channel1->MADDR = (uint32_t)VDD_buffer;
+  DMA1_Channel1->CNTR  = VDD_SAMPLES;
+  DMA1_Channel1->CFGR  = DMA_CFGR1_MINC   // increment memory address
+                       | DMA_CFGR1_CIRC   // circular mode
+                       | DMA_CFGR1_PSIZE_0// 16-bit peripheral size
+                       | DMA_CFGR1_MSIZE_0// 16-bit memory size
+                       | DMA_CFGR1_EN;    // enable channel
+
+  // Start continuous conversion
+  ADC1->CTLR2     |= ADC_CONT | ADC_DMA;  // continuous mode, DMA request
+  ADC1->CTLR2     |= ADC_SWSTART;         // start first conversion
+
+  // Setup PVD interrupt on falling VDD
+  PVD_enable();                           // enable PVD
+  VDD_PVD_set();                          // set detection level
+  PVD_RT_enable();                        // PVDO rises when VDD falls below level
+  PVD_INT_enable();                       // enable EXTI line 8 interrupt
+  NVIC_SetPriority(PVD_IRQn, 0x80);       // low priority (USB must preempt)
+  NVIC_EnableIRQ(PVD_IRQn);
+}
+
+// ===================================================================================
+// Evaluate Samples and Update NeoPixel Budget
+// ===================================================================================
+void VDD_update(void) {
+  uint32_t sum = 0;
+  uint16_t mv, budget;
+  uint8_t  i;
+
+  // Average completed buffer
+  if(!(DMA1->INTFR & DMA_TCIF1)) return;  // no new samples yet
+  DMA1->INTFCR = DMA_CTCIF1;
+  for(i=0; i<VDD_SAMPLES; i++) sum += VDD_buffer[i];
+  if(!sum) return;
+  mv = ((uint32_t)1200 * 1023 * VDD_SAMPLES) / sum;
+  VDD_mV = mv;
+
+  // Derate NeoPixel budget
+  if(PVD_isLow() || (mv <= VDD_MIN_mV)) budget = 0;
+  else if(mv >= VDD_FULL_mV) budget = NEO_MAX_mA;
+  else budget = ((uint32_t)NEO_MAX_mA * (mv - VDD_MIN_mV)) / VDD_SPAN_mV;
+  if(budget != NEO_budget) NEO_setBudget(budget);
+}
+
+// ===================================================================================
+// PVD Interrupt Service Routine: Fast Brightness Cut
+// ===================================================================================
+void PVD_IRQHandler(void) __attribute__((interrupt));
+void PVD_IRQHandler(void) {
+  EXTI->INTFR = ((uint32_t)1 << 8);       // clear interrupt flag
+  if(PVD_isLow()) {
+    NEO_setBudget(0);                     // cut brightness with next frame
+    VDD_dips++;
+  }
+}
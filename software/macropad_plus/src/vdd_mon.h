@@ -0,0 +1,62 @@
+// ===================================================================================
+// Supply Voltage Monitor using ADC, DMA and PVD for CH32V003                 * v1.0 *
+// ===================================================================================
+//
+// This library monitors the supply voltage (VDD) in the background and derates the
+// current budget of the NeoPixel governor when the supply sags.
+//
+// Functions available:
+// --------------------
+// VDD_init()               init ADC/DMA sampling of VDD and PVD interrupt
+// VDD_update()             evaluate new samples and update NeoPixel budget
+// VDD_get()                get last measured supply voltage in millivolts (mV)
+// VDD_suspend()            stop sampling (e.g. during USB suspend)
+// VDD_resume()             restart sampling
+//
+// Notes:
+// ------
+// - The ADC converts the internal reference voltage (Vref) continuously, DMA
+//   channel 1 writes the results into a small circular buffer. No CPU time is
+//   spent until VDD_update() averages a completed buffer.
+// - VDD_update() must be called regularly (e.g. in the main loop). Between
+//   VDD_FULL_mV and VDD_MIN_mV the NeoPixel budget is reduced linearly.
+// - The PVD interrupt cuts the NeoPixel budget immediately when VDD falls below
+//   the PVD level. The governor then releases the brightness smoothly after the
+//   supply has recovered.
+// - The board is supplied by USB VBUS through a Schottky diode (no LDO), so VDD
+//   is about 0.3V below VBUS.
+// - VDD_init() must be called after HID_init(), because the USB setup overwrites
+//   the EXTI interrupt enable register.
+// - ADC and DMA channel 1 are no longer available for other functionalities.
+//
+// 2024 by Stefan Wagner:   https://github.com/wagiminator
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "system.h"
+#include "neo_spi.h"
+
+// VDD Monitor Parameters
+#define VDD_SAMPLES       8     // number of samples averaged (power of 2)
+#define VDD_FULL_mV       4300  // full NeoPixel budget at or above this voltage
+#define VDD_MIN_mV        3900  // NeoPixels off (idle current only) at or below
+#define VDD_PVD_set()     PVD_set_3V9() // PVD level for fast brightness cut
+
+// VDD Monitor Functions
+#define VDD_get()         (VDD_mV)
+#define VDD_suspend()     ADC1->CTLR2 &= ~ADC_ADON
+#define VDD_resume()      {ADC1->CTLR2 |= ADC_ADON; ADC1->CTLR2 |= ADC_SWSTART;}
+void VDD_init(void);
+void VDD_update(void);
+
+// Telemetry
+extern volatile uint16_t VDD_mV;        // last measured supply voltage in mV
+extern volatile uint16_t VDD_dips;      // number of PVD brightness cuts
+
+#ifdef __cplusplus
+};
+#endif